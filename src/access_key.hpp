@@ -0,0 +1,195 @@
+#ifndef ACCESS_KEY_HPP
+#define ACCESS_KEY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/*
+ * Search helpers for a sorted array of fixed-width keys, with the width
+ * known at compile time. Keys are compared as big-endian integers, which
+ * orders them exactly like memcmp, so for 4 and 8 byte keys (a packed 4
+ * byte UID, or a whole struct uid with the default UID_MAX_BYTES) a compare
+ * is one load, one byte swap and one integer compare instead of a memcmp
+ * call.
+ *
+ * The last few keys of a search are scanned rather than bisected. For 8
+ * byte keys on x86 the scan compares 4 keys per instruction with AVX2, or 2
+ * with SSE2; elsewhere (the RP2040) it is a plain loop.
+ *
+ * The keys are a plain count * UidBytes byte array owned by the caller;
+ * nothing is allocated. src/acl_list.cpp exposes the search to the C code.
+ */
+template <std::size_t UidBytes> struct AccessKey {
+	static_assert(UidBytes > 0, "keys can't be empty");
+
+	static int compare(const std::uint8_t *a, const std::uint8_t *b)
+	{
+		if constexpr (UidBytes == 8) {
+			std::uint64_t x = load<std::uint64_t>(a);
+			std::uint64_t y = load<std::uint64_t>(b);
+			return (x > y) - (x < y);
+		} else if constexpr (UidBytes == 4) {
+			std::uint32_t x = load<std::uint32_t>(a);
+			std::uint32_t y = load<std::uint32_t>(b);
+			return (x > y) - (x < y);
+		} else {
+			return std::memcmp(a, b, UidBytes);
+		}
+	}
+
+	static bool equal(const std::uint8_t *a, const std::uint8_t *b)
+	{
+		if constexpr (UidBytes == 8 || UidBytes == 4) {
+			// no byte swap needed to test for equality
+			return std::memcmp(a, b, UidBytes) == 0;
+		} else {
+			return compare(a, b) == 0;
+		}
+	}
+
+	/* searches end with a linear scan once this few keys are left */
+	static constexpr std::size_t scan_keys = 16;
+
+	/*
+	 * Index of the first of `count` sorted keys that is not less than
+	 * `key`.
+	 */
+	static std::size_t lower_bound(const std::uint8_t *keys,
+		std::size_t count, const std::uint8_t *key)
+	{
+		std::size_t lo = 0;
+		std::size_t hi = count;
+
+		while (hi - lo > scan_keys) {
+			std::size_t mid = lo + (hi - lo) / 2;
+			if (compare(keys + mid * UidBytes, key) < 0) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+		return lo + count_less(keys + lo * UidBytes, hi - lo, key);
+	}
+
+	/*
+	 * lower_bound() for a key known to be no less than every key before
+	 * `from`, as when walking sorted keys in order. It looks 1, 2, 4, ...
+	 * keys ahead, so a run of nearby keys costs a few compares each
+	 * however long the list is.
+	 */
+	static std::size_t gallop(const std::uint8_t *keys, std::size_t count,
+		std::size_t from, const std::uint8_t *key)
+	{
+		std::size_t lo = from;
+		std::size_t hi = from;
+		std::size_t step = 1;
+
+		while (hi < count && compare(keys + hi * UidBytes, key) < 0) {
+			lo = hi + 1;
+			hi += step;
+			step *= 2;
+		}
+		if (hi > count) {
+			hi = count;
+		}
+		return lo + lower_bound(keys + lo * UidBytes, hi - lo, key);
+	}
+
+	/*
+	 * How many of `count` sorted keys are less than `key`.
+	 */
+	static std::size_t count_less(const std::uint8_t *keys,
+		std::size_t count, const std::uint8_t *key)
+	{
+		std::size_t i = 0;
+#if defined(__AVX2__)
+		if constexpr (UidBytes == 8) {
+			// byte swap each key, then flip the sign bit so the
+			// signed compare orders them as unsigned
+			const __m256i swap = _mm256_setr_epi8(7, 6, 5, 4, 3, 2,
+				1, 0, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4,
+				3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+			const __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+			std::uint64_t k = load<std::uint64_t>(key);
+			const __m256i needle = _mm256_xor_si256(
+				_mm256_set1_epi64x((long long)k), sign);
+			std::size_t less = 0;
+
+			for (; i + 4 <= count; i += 4) {
+				__m256i v = _mm256_loadu_si256(
+					(const __m256i *)(keys + i * 8));
+				v = _mm256_xor_si256(
+					_mm256_shuffle_epi8(v, swap), sign);
+				__m256i lt = _mm256_cmpgt_epi64(needle, v);
+				int mask = _mm256_movemask_pd(
+					_mm256_castsi256_pd(lt));
+				less += __builtin_popcount(mask);
+			}
+			if (less < i) {
+				return less;
+			}
+		}
+#elif defined(__SSE2__)
+		if constexpr (UidBytes == 8) {
+			// no 64-bit compare or byte shuffle in SSE2: swap the
+			// 16-bit words, then the bytes within them, and
+			// compare the high and low halves separately
+			const __m128i sign = _mm_set1_epi32(INT32_MIN);
+			std::uint64_t k = load<std::uint64_t>(key);
+			const __m128i needle = _mm_xor_si128(
+				_mm_set1_epi64x((long long)k), sign);
+			std::size_t less = 0;
+
+			for (; i + 2 <= count; i += 2) {
+				__m128i v = _mm_loadu_si128(
+					(const __m128i *)(keys + i * 8));
+				v = _mm_shufflelo_epi16(v, 0x1B);
+				v = _mm_shufflehi_epi16(v, 0x1B);
+				v = _mm_or_si128(_mm_slli_epi16(v, 8),
+					_mm_srli_epi16(v, 8));
+				v = _mm_xor_si128(v, sign);
+
+				__m128i lt = _mm_cmpgt_epi32(needle, v);
+				__m128i eq = _mm_cmpeq_epi32(needle, v);
+				__m128i hi_lt = _mm_shuffle_epi32(lt, 0xF5);
+				__m128i hi_eq = _mm_shuffle_epi32(eq, 0xF5);
+				__m128i lo_lt = _mm_shuffle_epi32(lt, 0xA0);
+				__m128i result = _mm_or_si128(hi_lt,
+					_mm_and_si128(hi_eq, lo_lt));
+				int mask = _mm_movemask_pd(
+					_mm_castsi128_pd(result));
+				less += __builtin_popcount(mask);
+			}
+			if (less < i) {
+				return less;
+			}
+		}
+#endif
+		while (i < count && compare(keys + i * UidBytes, key) < 0) {
+			i++;
+		}
+		return i;
+	}
+
+private:
+	template <typename T> static T load(const std::uint8_t *p)
+	{
+		T value;
+		std::memcpy(&value, p, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		if constexpr (sizeof(T) == 8) {
+			value = __builtin_bswap64(value);
+		} else {
+			value = __builtin_bswap32(value);
+		}
+#endif
+		return value;
+	}
+};
+
+#endif // ACCESS_KEY_HPP
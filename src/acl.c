@@ -1,235 +1,1889 @@
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "acl.h"
+#include "acl_attr.h"
+#include "acl_list.h"
 
+#include "crc32.h"
 #include "fs.h"
 
+/* acl_load() reads the file in blocks of this size */
+#define ACL_READ_BLOCK 512
+
+/* acl_save() writes "<file_path>.tmp" first */
+#define ACL_PATH_LENGTH 64
+
+/*
+ * Single changes are appended to "<file_path>.log" instead of rewriting the
+ * snapshot. acl_load() replays the journal on top of the snapshot and
+ * acl_save() empties it.
+ *
+ * Every save numbers the snapshot with the next epoch, and each record
+ * carries the epoch of the snapshot it was appended to. A power cut after
+ * the new snapshot is in place but before the journal is emptied leaves
+ * records from the previous epoch behind; they are already in the snapshot,
+ * so acl_load() skips them instead of applying them twice.
+ *
+ * `op` is one of the ACL_OP_ types. A change that came with a generation
+ * has ACL_JOURNAL_NEXT set; it is always the one after the previous
+ * generation, so the number itself isn't stored.
+ */
+#define ACL_JOURNAL_NEXT 0x01
+
+struct acl_journal_record {
+	uint8_t op;
+	uint8_t value;
+	uint8_t flags;
+	uint8_t reserved;
+	uint32_t epoch;
+	/* CRC-32 of the record with crc = 0, to catch a torn last write */
+	uint32_t crc;
+	struct uid uid;
+};
+
+/*
+ * Binary ACL file written by acl_save():
+ *
+ *   struct acl_file_header
+ *   struct uid users[user_count]     sorted
+ *   struct uid revoked[revoked_count]  image members that were removed
+ *   struct acl_schedule schedules[schedule_count]
+ *   struct acl_attr scheduled[scheduled_count]  schedule IDs
+ *   struct acl_attr doors[door_count]           door masks
+ *   struct acl_op ops[op_count]  the op log, oldest first
+ *
+ * The header stores the ACL hash and bucket hashes so a file that passes the
+ * CRC (over the header with crc = 0, then the records) is used as is,
+ * without parsing or re-hashing. They are only trusted if the same image is
+ * attached as when the file was saved.
+ *
+ * A file with another version is ignored. Bump ACL_FILE_VERSION whenever
+ * the layout changes instead of keeping readers for older layouts.
+ */
+#define ACL_FILE_MAGIC 0x464c4341 // "ACLF"
+#define ACL_FILE_VERSION 1
+
+struct acl_file_header {
+	uint32_t magic;
+	uint16_t version;
+	uint8_t uid_bytes;
+	uint8_t reserved;
+	uint32_t user_count;
+	uint32_t revoked_count;
+	uint32_t image_count;
+	uint32_t image_hash;
+	uint32_t acl_hash;
+	uint32_t crc;
+	uint32_t buckets[ACL_MERKLE_BUCKETS];
+	uint16_t schedule_count;
+	uint16_t reserved2;
+	uint32_t scheduled_count;
+	uint32_t door_count;
+	uint32_t generation;
+	uint32_t op_count;
+	uint32_t epoch;
+};
+
+#if WITH_FS
+static void acl_sort_unique(struct access_control_list *acl);
+#endif
+static void acl_rehash(struct access_control_list *acl);
+static int acl_add_user(
+	struct access_control_list *acl, const struct uid *user);
+static int acl_drop_user(
+	struct access_control_list *acl, const struct uid *user);
+static int acl_change(
+	struct access_control_list *acl, const struct acl_op *op);
+
+/*
+ * The ACL hash is the sum (mod 2^32) of a per-user digest. Addition is
+ * commutative, so the hash doesn't depend on the order of the list, and
+ * adding or removing a user is a single add or subtract instead of a pass
+ * over every entry.
+ */
+static uint32_t acl_user_digest(struct access_control_list *acl,
+	const struct uid *user, uint32_t key)
+{
+	uint8_t schedule = acl_user_schedule(acl, user);
+	uint8_t doors = acl_user_doors(acl, user);
+	if (schedule == ACL_SCHEDULE_ALWAYS && doors == ACL_DOORS_ALL) {
+		return key;
+	}
+
+	// the doors a member may not use, so an unrestricted member's seed is 0
+	uint32_t seed = (uint32_t)(uint8_t)~doors << 24;
+	if (schedule != ACL_SCHEDULE_ALWAYS) {
+		seed ^= acl->schedule_hashes[schedule - 1];
+	}
+	return uid_hash(user, seed);
+}
+
+/*
+ * The bucket only depends on the UID, so a member stays in the same bucket
+ * when their schedule or doors change.
+ */
+static void acl_hash_add(
+	struct access_control_list *acl, const struct uid *user)
+{
+	uint32_t key = uid_hash(user, 0);
+	uint32_t digest = acl_user_digest(acl, user, key);
+	acl->hash += digest;
+	acl->buckets[acl_merkle_bucket(key)] += digest;
+}
+
+static void acl_hash_remove(
+	struct access_control_list *acl, const struct uid *user)
+{
+	uint32_t key = uid_hash(user, 0);
+	uint32_t digest = acl_user_digest(acl, user, key);
+	acl->hash -= digest;
+	acl->buckets[acl_merkle_bucket(key)] -= digest;
+}
+
+/*
+ * Forget `user`'s schedule and doors. Called after the user has left the
+ * list, once their digest is no longer needed.
+ */
+static void acl_forget_user(
+	struct access_control_list *acl, const struct uid *user)
+{
+	acl_attr_remove(&acl->scheduled, user);
+	acl_attr_remove(&acl->doors, user);
+}
+
+/*
+ * Make room for at least `count` users. The list is the only allocation in
+ * the ACL's arena, so it grows in place in ACL_GROW_USERS chunks and stays
+ * contiguous.
+ */
+static bool acl_reserve(struct access_control_list *acl, size_t count)
+{
+	if (count <= acl->user_capacity) {
+		return true;
+	}
+
+	size_t capacity = acl->user_capacity;
+	while (capacity < count) {
+		capacity += ACL_GROW_USERS;
+	}
+
+	size_t old_size = acl->user_capacity * sizeof(struct uid);
+	size_t new_size = capacity * sizeof(struct uid);
+	if (!acl->users) {
+		acl->users = arena_alloc(&acl->arena, new_size);
+		if (!acl->users) {
+			return false;
+		}
+	} else if (!arena_extend(
+			   &acl->arena, acl->users, old_size, new_size)) {
+		return false;
+	}
+
+	acl->user_capacity = capacity;
+	return true;
+}
+
+/* bytes in the revoked bitmap for `image`: one bit per slot */
+static size_t acl_revoked_size(const struct acl_image *image)
+{
+	return acl_image_user_count(image) / 8 + 1;
+}
+
+/*
+ * Drop every user held in RAM. The arena is reset in one step rather than
+ * releasing entries one at a time.
+ */
+static void acl_clear(struct access_control_list *acl)
+{
+	if (acl->mapping) {
+		fs_unmap(acl->mapping, acl->mapping_size);
+		acl->mapping = NULL;
+		acl->mapping_size = 0;
+	}
+	arena_reset(&acl->arena);
+	acl->users = NULL;
+	acl->user_count = 0;
+	acl->user_capacity = 0;
+	acl->schedule_count = 0;
+	acl->scheduled.count = 0;
+	acl->doors.count = 0;
+	acl_oplog_reset(&acl->oplog, 0);
+}
+
+/*
+ * A list loaded from the ACL file may still be mapped in place. Copy it into
+ * the arena before anything changes it.
+ */
+static bool acl_make_writable(struct access_control_list *acl)
+{
+	if (!acl->mapping) {
+		return true;
+	}
+
+	const struct uid *mapped = acl->users;
+	size_t count = acl->user_count;
+
+	arena_reset(&acl->arena);
+	acl->users = NULL;
+	acl->user_capacity = 0;
+	if (!acl_reserve(acl, count)) {
+		fprintf(stderr, "[ACL] Cannot copy ACL. ACL arena is full.\n");
+		acl->users = (struct uid *)mapped;
+		acl->user_capacity = count;
+		return false;
+	}
+	memcpy(acl->users, mapped, count * sizeof(struct uid));
+
+	fs_unmap(acl->mapping, acl->mapping_size);
+	acl->mapping = NULL;
+	acl->mapping_size = 0;
+	return true;
+}
+
+/*
+ * Empty the ACL, including revocations of image members, but keep the image
+ * attached.
+ */
+void acl_reset(struct access_control_list *acl)
+{
+	acl_clear(acl);
+	if (acl->image) {
+		memset(acl->revoked, 0, acl_revoked_size(acl->image));
+	}
+	acl_rehash(acl);
+}
+
+/*
+ * Set up an empty ACL whose list may use up to `ram_budget` bytes.
+ * Returns 0 on success, -1 if the arena couldn't be reserved.
+ */
+int acl_init(struct access_control_list *acl, const char *file_path,
+	size_t ram_budget)
+{
+	memset(acl, 0, sizeof(*acl));
+	acl->file_path = file_path;
+	acl->door = ACL_DOOR;
+	return arena_init(&acl->arena, ram_budget);
+}
+
+/*
+ * Make `dst` an exact copy of `src`, using `dst`'s own arena.
+ * Returns 0 on success, -1 if `dst` doesn't have room.
+ */
+int acl_copy(struct access_control_list *dst,
+	const struct access_control_list *src)
+{
+	acl_clear(dst);
+	if (!acl_reserve(dst, src->user_count)) {
+		fprintf(stderr, "[ACL] Cannot copy ACL. ACL arena is full.\n");
+		return -1;
+	}
+
+	if (dst->image != src->image) {
+		free(dst->revoked);
+		dst->revoked = NULL;
+		dst->image = NULL;
+		if (src->image) {
+			dst->revoked = malloc(acl_revoked_size(src->image));
+			if (!dst->revoked) {
+				fprintf(stderr,
+					"[ACL] No memory to copy ACL.\n");
+				return -1;
+			}
+			dst->image = src->image;
+		}
+	}
+	if (src->image) {
+		memcpy(dst->revoked, src->revoked,
+			acl_revoked_size(src->image));
+	}
+
+	if (acl_attr_copy(&dst->scheduled, &src->scheduled) != 0
+		|| acl_attr_copy(&dst->doors, &src->doors) != 0) {
+		fprintf(stderr, "[ACL] No memory to copy ACL.\n");
+		return -1;
+	}
+	memcpy(dst->schedules, src->schedules,
+		src->schedule_count * sizeof(struct acl_schedule));
+	memcpy(dst->schedule_hashes, src->schedule_hashes,
+		src->schedule_count * sizeof(uint32_t));
+	dst->schedule_count = src->schedule_count;
+	dst->door = src->door;
+	dst->oplog = src->oplog;
+
+	memcpy(dst->users, src->users, src->user_count * sizeof(struct uid));
+	dst->user_count = src->user_count;
+	dst->hash = src->hash;
+	memcpy(dst->buckets, src->buckets, sizeof(dst->buckets));
+	dst->file_path = src->file_path;
+	dst->journal_count = src->journal_count;
+	dst->epoch = src->epoch;
+	return 0;
+}
+
+void acl_free(struct access_control_list *acl)
+{
+	acl_clear(acl);
+	free(acl->revoked);
+	acl_attr_free(&acl->scheduled);
+	acl_attr_free(&acl->doors);
+	arena_free(&acl->arena);
+	memset(acl, 0, sizeof(*acl));
+}
+
+static void acl_set_revoked(
+	struct access_control_list *acl, size_t slot, bool revoked)
+{
+	if (revoked) {
+		acl->revoked[slot / 8] |= (uint8_t)(1u << (slot % 8));
+	} else {
+		acl->revoked[slot / 8] &= (uint8_t)~(1u << (slot % 8));
+	}
+}
+
+/*
+ * Look `user` up in the attached image, if any. `slot` is set whenever the
+ * image contains the user, even if it has since been revoked.
+ */
+static bool acl_image_has(
+	struct access_control_list *acl, const struct uid *user, size_t *slot)
+{
+	if (!acl->image || !acl_image_lookup(acl->image, user, slot)) {
+		return false;
+	}
+	return !acl_slot_revoked(acl, *slot);
+}
+
+#if WITH_FS
+/*
+ * Reads a file one block at a time and hands out lines in place, so loading
+ * costs one fs_read_data() call per block instead of one per byte.
+ */
+struct line_reader {
+	File file;
+	size_t pos;
+	size_t len;
+	bool eof;
+	char buf[ACL_READ_BLOCK];
+};
+
+static void line_reader_init(struct line_reader *reader, File file)
+{
+	reader->file = file;
+	reader->pos = 0;
+	reader->len = 0;
+	reader->eof = false;
+}
+
+/*
+ * Return the next line, NUL terminated inside the block buffer and without
+ * its line ending. The pointer is valid until the next call. Lines longer
+ * than the buffer are split. Returns NULL at end of file.
+ */
+static char *line_reader_next(struct line_reader *reader)
+{
+	while (true) {
+		char *start = reader->buf + reader->pos;
+		char *nl = memchr(start, '\n', reader->len - reader->pos);
+
+		if (nl || reader->eof
+			|| (reader->pos == 0
+				&& reader->len == sizeof(reader->buf) - 1)) {
+			if (!nl && reader->pos == reader->len) {
+				return NULL;
+			}
+
+			char *end = nl ? nl : reader->buf + reader->len;
+			reader->pos = nl ? (size_t)(nl - reader->buf) + 1
+					 : reader->len;
+			if (end > start && end[-1] == '\r') {
+				end--;
+			}
+			*end = '\0';
+			return start;
+		}
+
+		// Move the partial line to the front and fill the rest
+		reader->len -= reader->pos;
+		memmove(reader->buf, start, reader->len);
+		reader->pos = 0;
+
+		size_t n = fs_read_data(reader->file, reader->buf + reader->len,
+			sizeof(reader->buf) - 1 - reader->len);
+		if (n == 0) {
+			reader->eof = true;
+		}
+		reader->len += n;
+	}
+}
+#endif
+
+#if WITH_FS
+static bool acl_file_ok(File file)
+{
+#ifdef __PICO_BUILD__
+	return file.handle != NULL;
+#else
+	return file.fd >= 0;
+#endif
+}
+
+/* write `size` bytes, or nothing when `size` is 0 */
+static bool acl_file_write(File file, const void *data, size_t size)
+{
+	return size == 0 || fs_write_data(file, data, size) == size;
+}
+
+/* CRC of the header with crc = 0, to be continued over the records */
+static uint32_t acl_file_crc(const struct acl_file_header *header)
+{
+	struct acl_file_header copy = *header;
+	copy.crc = 0;
+	return crc32_update(0, &copy, sizeof(copy));
+}
+
+/* the records that follow the header, in file order */
+enum {
+	ACL_FILE_USERS,
+	ACL_FILE_SCHEDULES,
+	ACL_FILE_SCHEDULED,
+	ACL_FILE_DOORS,
+	ACL_FILE_OPS,
+	ACL_FILE_SECTIONS,
+};
+
+/*
+ * Load the binary format. On Linux the file is mapped and the users are used
+ * in place; elsewhere they are read into the arena with one bulk read.
+ *
+ * Returns 0 on success, -1 if the file is missing or not in the binary
+ * format, 1 if it is damaged (the ACL is left empty).
+ */
+static int acl_load_binary(
+	struct access_control_list *acl, const char *file_path)
+{
+	struct acl_file_header header;
+	memset(&header, 0, sizeof(header));
+	size_t header_size = 0;
+	size_t map_size = 0;
+
+	const uint8_t *data = fs_map(file_path, &map_size);
+	File file = {0};
+	if (data) {
+		header_size = sizeof(header);
+		if (map_size < header_size) {
+			header_size = map_size;
+		}
+		memcpy(&header, data, header_size);
+	} else {
+		file = fs_open(file_path, FS_O_RDONLY);
+		if (!acl_file_ok(file)) {
+			return -1;
+		}
+		header_size = fs_read_data(file, &header, sizeof(header));
+	}
+
+	if (header.magic != ACL_FILE_MAGIC) {
+		if (data) {
+			fs_unmap(data, map_size);
+		} else {
+			fs_close(file);
+		}
+		return -1;
+	}
+
+	size_t total = (size_t)header.user_count + header.revoked_count;
+	size_t want[ACL_FILE_SECTIONS] = {
+		[ACL_FILE_USERS] = total * sizeof(struct uid),
+		[ACL_FILE_SCHEDULES] = (size_t)header.schedule_count
+			* sizeof(struct acl_schedule),
+		[ACL_FILE_SCHEDULED] = (size_t)header.scheduled_count
+			* sizeof(struct acl_attr),
+		[ACL_FILE_DOORS] =
+			(size_t)header.door_count * sizeof(struct acl_attr),
+		[ACL_FILE_OPS] =
+			(size_t)header.op_count * sizeof(struct acl_op),
+	};
+
+	const char *error = NULL;
+	if (header_size != sizeof(header)) {
+		error = "truncated";
+	} else if (header.version != ACL_FILE_VERSION) {
+		error = "unsupported version";
+	} else if (header.uid_bytes != UID_MAX_BYTES) {
+		error = "wrong UID width";
+	} else if (header.schedule_count > ACL_MAX_SCHEDULES) {
+		error = "too many schedules";
+	} else if (header.op_count > ACL_OPLOG_SIZE
+		|| header.op_count > header.generation) {
+		error = "too many ops";
+	} else if ((!data && !acl_reserve(acl, total))
+		|| !acl_attr_reserve(&acl->scheduled, header.scheduled_count)
+		|| !acl_attr_reserve(&acl->doors, header.door_count)) {
+		error = "out of memory";
+	}
+
+	// where each section ends up, and where it is read from
+	uint8_t *dst[ACL_FILE_SECTIONS] = {
+		[ACL_FILE_USERS] = (uint8_t *)acl->users,
+		[ACL_FILE_SCHEDULES] = (uint8_t *)acl->schedules,
+		[ACL_FILE_SCHEDULED] = (uint8_t *)acl->scheduled.entries,
+		[ACL_FILE_DOORS] = (uint8_t *)acl->doors.entries,
+		[ACL_FILE_OPS] = (uint8_t *)acl->oplog.ops,
+	};
+	const uint8_t *src[ACL_FILE_SECTIONS];
+	size_t offset = header_size;
+	for (int i = 0; !error && i < ACL_FILE_SECTIONS; i++) {
+		if (data) {
+			if (map_size - offset < want[i]) {
+				error = "truncated";
+				break;
+			}
+			src[i] = data + offset;
+		} else {
+			if (want[i]
+				&& fs_read_data(file, dst[i], want[i])
+					!= want[i]) {
+				error = "truncated";
+				break;
+			}
+			src[i] = dst[i];
+		}
+		offset += want[i];
+	}
+	if (!data) {
+		fs_close(file);
+	}
+
+	if (!error) {
+		uint32_t crc = acl_file_crc(&header);
+		for (int i = 0; i < ACL_FILE_SECTIONS; i++) {
+			crc = crc32_update(crc, src[i], want[i]);
+		}
+		if (crc != header.crc) {
+			error = "CRC mismatch";
+		}
+	}
+	if (error) {
+		fprintf(stderr, "[ACL] Ignoring '%s': %s.\n", file_path, error);
+		if (data) {
+			fs_unmap(data, map_size);
+		}
+		acl_clear(acl);
+		return 1;
+	}
+
+	const struct uid *records = (const struct uid *)src[ACL_FILE_USERS];
+	if (data) {
+		acl->users = (struct uid *)records;
+		acl->user_capacity = header.user_count;
+		acl->mapping = data;
+		acl->mapping_size = map_size;
+		for (int i = ACL_FILE_SCHEDULES; i < ACL_FILE_SECTIONS; i++) {
+			if (want[i]) {
+				memcpy(dst[i], src[i], want[i]);
+			}
+		}
+	}
+	acl->user_count = header.user_count;
+
+	acl->schedule_count = header.schedule_count;
+	for (size_t i = 0; i < acl->schedule_count; i++) {
+		acl->schedule_hashes[i] =
+			acl_schedule_hash(&acl->schedules[i]);
+	}
+	acl->scheduled.count = 0;
+	for (size_t i = 0; i < header.scheduled_count; i++) {
+		uint8_t schedule = acl->scheduled.entries[i].value;
+		if (schedule != ACL_SCHEDULE_ALWAYS
+			&& schedule <= acl->schedule_count) {
+			acl->scheduled.entries[acl->scheduled.count++] =
+				acl->scheduled.entries[i];
+		}
+	}
+	acl->doors.count = header.door_count;
+	acl->oplog.head = 0;
+	acl->oplog.count = header.op_count;
+	acl->oplog.start = header.generation - header.op_count;
+	acl->oplog.generation = header.generation;
+	acl->epoch = header.epoch;
+
+	for (size_t i = header.user_count; i < total; i++) {
+		size_t slot;
+		if (acl->image
+			&& acl_image_lookup(acl->image, &records[i], &slot)) {
+			acl_set_revoked(acl, slot, true);
+		}
+	}
+
+	uint32_t image_count = 0;
+	uint32_t image_hash = 0;
+	if (acl->image) {
+		image_count = (uint32_t)acl_image_user_count(acl->image);
+		image_hash = acl->image->header->acl_hash;
+	}
+	if (header.image_count == image_count
+		&& header.image_hash == image_hash) {
+		acl->hash = header.acl_hash;
+		memcpy(acl->buckets, header.buckets, sizeof(acl->buckets));
+	} else {
+		acl_rehash(acl);
+	}
+	return 0;
+}
+
+/*
+ * Import the older text format: one hex UID per line, and "-<uid>" for a
+ * removed image member.
+ */
+static void acl_load_text(
+	struct access_control_list *acl, const char *file_path)
+{
+	File file = fs_open(file_path, FS_O_RDONLY);
+	if (!acl_file_ok(file)) {
+		acl_rehash(acl);
+		return;
+	}
+
+	struct line_reader reader;
+	line_reader_init(&reader, file);
+
+	char *line;
+	while ((line = line_reader_next(&reader)) != NULL) {
+		if (line[0] == '\0') {
+			continue;
+		}
+
+		// "-<uid>" revokes a member of the attached image
+		bool revoke = line[0] == '-';
+
+		struct uid uid;
+		if (uid_from_hex(&uid, revoke ? line + 1 : line) != 0) {
+			fprintf(stderr, "[ACL] Skipping invalid UID '%s'.\n",
+				line);
+			continue;
+		}
+
+		size_t slot;
+		if (acl_image_has(acl, &uid, &slot)) {
+			if (revoke) {
+				acl_set_revoked(acl, slot, true);
+			}
+			continue;
+		}
+		if (revoke) {
+			continue;
+		}
+
+		if (!acl_reserve(acl, acl->user_count + 1)) {
+			fprintf(stderr, "[ACL] ACL arena is full.\n");
+			break;
+		}
+		acl->users[acl->user_count] = uid;
+		acl->user_count++;
+	}
+
+	fs_close(file);
+
+	acl_sort_unique(acl);
+	acl_rehash(acl);
+}
+
+static bool acl_journal_path(
+	const struct access_control_list *acl, char *path, size_t size)
+{
+	if (snprintf(path, size, "%s.log", acl->file_path) >= (int)size) {
+		fprintf(stderr, "[ACL] File path '%s' is too long.\n",
+			acl->file_path);
+		return false;
+	}
+	return true;
+}
+
+static uint32_t acl_journal_crc(const struct acl_journal_record *record)
+{
+	struct acl_journal_record copy = *record;
+	copy.crc = 0;
+	return crc32_update(0, &copy, sizeof(copy));
+}
+
+/*
+ * Apply the journal on top of the loaded snapshot. Every record applied
+ * when it was appended, so one that doesn't apply now means the journal and
+ * the snapshot disagree: replay stops there rather than skip it, and the
+ * list stays at the last change that did apply. A generation left behind
+ * that way is caught up by the server's next sync.
+ *
+ * Returns false if replay stopped early, in which case anything appended
+ * after it would be lost on the next load, or if the journal holds records
+ * of an earlier snapshot, which must not be replayed again either.
+ */
+static bool acl_journal_replay(struct access_control_list *acl)
+{
+	char path[ACL_PATH_LENGTH];
+	if (!acl_journal_path(acl, path, sizeof(path))) {
+		return true;
+	}
+
+	File file = fs_open(path, FS_O_RDONLY);
+	if (!acl_file_ok(file)) {
+		return true;
+	}
+
+	struct acl_journal_record
+		records[ACL_READ_BLOCK / sizeof(struct acl_journal_record)];
+	bool intact = true;
+	bool applies = true;
+	size_t stale = 0;
+	size_t bytes;
+	while (intact && applies
+		&& (bytes = fs_read_data(file, records, sizeof(records))) > 0) {
+		size_t count = bytes / sizeof(records[0]);
+		if (bytes % sizeof(records[0]) != 0) {
+			intact = false;
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			const struct acl_journal_record *record = &records[i];
+			if (acl_journal_crc(record) != record->crc) {
+				intact = false;
+				break;
+			}
+			if (record->epoch != acl->epoch) {
+				stale++;
+				continue;
+			}
+			struct acl_op op;
+			memset(&op, 0, sizeof(op));
+			op.type = record->op;
+			op.value = record->value;
+			op.user = record->uid;
+			if (acl_change(acl, &op) < 0) {
+				applies = false;
+				break;
+			}
+			if (record->flags & ACL_JOURNAL_NEXT) {
+				op.generation = acl->oplog.generation + 1;
+				acl_oplog_push(&acl->oplog, &op);
+			}
+			acl->journal_count++;
+		}
+	}
+	fs_close(file);
+
+	if (!intact) {
+		fprintf(stderr, "[ACL] Journal '%s' is damaged.\n", path);
+	}
+	if (!applies) {
+		fprintf(stderr,
+			"[ACL] Journal '%s' doesn't match the snapshot after "
+			"%zu changes.\n",
+			path, acl->journal_count);
+	}
+	if (stale) {
+		fprintf(stderr,
+			"[ACL] Skipped %zu journaled changes already saved.\n",
+			stale);
+	}
+	return intact && applies && !stale;
+}
+#endif
+
+/*
+ * Record a single change with one small append. Once the journal is long
+ * enough, fold it into a new snapshot. `next` is set for an op that came
+ * with the next generation, which must already be in the op log.
+ */
+static void acl_journal_append(struct access_control_list *acl,
+	const struct acl_op *op, bool next)
+{
+#if WITH_FS
+	char path[ACL_PATH_LENGTH];
+	if (!acl->file_path || !acl_journal_path(acl, path, sizeof(path))) {
+		return;
+	}
+
+	if (acl->journal_count >= ACL_JOURNAL_COMPACT) {
+		acl_save(acl);
+		// a save that failed kept the journal, so append to it
+		if (acl->journal_count == 0) {
+			return;
+		}
+	}
+
+	struct acl_journal_record record;
+	memset(&record, 0, sizeof(record));
+	record.op = op->type;
+	record.value = op->value;
+	record.flags = next ? ACL_JOURNAL_NEXT : 0;
+	record.epoch = acl->epoch;
+	record.uid = op->user;
+	record.crc = acl_journal_crc(&record);
+
+	File file = fs_open(path, FS_O_WRONLY | FS_O_CREAT | FS_O_APPEND);
+	if (!acl_file_ok(file)) {
+		fprintf(stderr, "[ACL] Failed to open file '%s' for writing.\n",
+			path);
+		return;
+	}
+	if (fs_write_data(file, &record, sizeof(record)) != sizeof(record)) {
+		fprintf(stderr, "[ACL] Failed to append to '%s'.\n", path);
+	}
+	fs_close(file);
+	acl->journal_count++;
+#else
+	(void)acl;
+	(void)op;
+	(void)next;
+#endif
+}
+
+void acl_load(struct access_control_list *acl, const char *file_path)
+{
 #if WITH_FS
-static size_t fs_read_line(File file, char *buffer, size_t max_len)
+	acl->file_path = file_path;
+	acl->journal_count = 0;
+	acl->epoch = 0;
+	acl_clear(acl);
+	if (acl->image) {
+		memset(acl->revoked, 0, acl_revoked_size(acl->image));
+	}
+
+	int status = acl_load_binary(acl, file_path);
+	if (status < 0) {
+		acl_load_text(acl, file_path);
+	} else if (status > 0) {
+		acl_rehash(acl);
+	}
+
+	if (!acl_journal_replay(acl)) {
+		acl_save(acl);
+	}
+#else
+	(void)acl;
+	(void)file_path;
+#endif
+}
+
+/*
+ * Write the binary format to "<file_path>.tmp" and rename it over the old
+ * file, so a mapped copy of the old file stays valid and a power cut never
+ * leaves a half written ACL behind. The journal is emptied afterwards; if
+ * any write fails, the temporary file is removed and both are kept.
+ */
+void acl_save(struct access_control_list *acl)
+{
+#if WITH_FS
+	char tmp_path[ACL_PATH_LENGTH];
+	if (!acl->file_path) {
+		return;
+	}
+	if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", acl->file_path)
+		>= (int)sizeof(tmp_path)) {
+		fprintf(stderr, "[ACL] File path '%s' is too long.\n",
+			acl->file_path);
+		return;
+	}
+
+	struct acl_file_header header;
+	memset(&header, 0, sizeof(header));
+	header.magic = ACL_FILE_MAGIC;
+	header.version = ACL_FILE_VERSION;
+	header.uid_bytes = UID_MAX_BYTES;
+	header.user_count = (uint32_t)acl->user_count;
+	header.acl_hash = acl->hash;
+	memcpy(header.buckets, acl->buckets, sizeof(header.buckets));
+
+	size_t image_count = acl->image ? acl_image_user_count(acl->image) : 0;
+	if (acl->image) {
+		header.image_count = (uint32_t)image_count;
+		header.image_hash = acl->image->header->acl_hash;
+	}
+
+	for (size_t slot = 0; slot < image_count; slot++) {
+		if (acl_slot_revoked(acl, slot)) {
+			header.revoked_count++;
+		}
+	}
+	header.schedule_count = (uint16_t)acl->schedule_count;
+	header.scheduled_count = (uint32_t)acl->scheduled.count;
+	header.door_count = (uint32_t)acl->doors.count;
+	header.generation = acl->oplog.generation;
+	header.op_count = (uint32_t)acl->oplog.count;
+	header.epoch = acl->epoch + 1;
+
+	size_t schedules_size =
+		acl->schedule_count * sizeof(struct acl_schedule);
+	size_t scheduled_size = acl->scheduled.count * sizeof(struct acl_attr);
+	size_t doors_size = acl->doors.count * sizeof(struct acl_attr);
+
+	uint32_t crc = acl_file_crc(&header);
+	crc = crc32_update(
+		crc, acl->users, acl->user_count * sizeof(struct uid));
+	for (size_t slot = 0; slot < image_count; slot++) {
+		if (acl_slot_revoked(acl, slot)) {
+			crc = crc32_update(crc, &acl->image->slots[slot],
+				sizeof(struct uid));
+		}
+	}
+	crc = crc32_update(crc, acl->schedules, schedules_size);
+	crc = crc32_update(crc, acl->scheduled.entries, scheduled_size);
+	crc = crc32_update(crc, acl->doors.entries, doors_size);
+	for (size_t i = 0; i < acl->oplog.count; i++) {
+		crc = crc32_update(crc, acl_oplog_at(&acl->oplog, i),
+			sizeof(struct acl_op));
+	}
+	header.crc = crc;
+
+	File file =
+		fs_open(tmp_path, FS_O_WRONLY | FS_O_CREAT | FS_O_TRUNC);
+	if (!acl_file_ok(file)) {
+		fprintf(stderr, "[ACL] Failed to open file '%s' for writing.\n",
+			tmp_path);
+		return;
+	}
+
+	bool ok = acl_file_write(file, &header, sizeof(header))
+		&& acl_file_write(file, acl->users,
+			acl->user_count * sizeof(struct uid));
+	for (size_t slot = 0; ok && slot < image_count; slot++) {
+		if (acl_slot_revoked(acl, slot)) {
+			ok = acl_file_write(file, &acl->image->slots[slot],
+				sizeof(struct uid));
+		}
+	}
+	ok = ok && acl_file_write(file, acl->schedules, schedules_size)
+		&& acl_file_write(file, acl->scheduled.entries, scheduled_size)
+		&& acl_file_write(file, acl->doors.entries, doors_size);
+	for (size_t i = 0; ok && i < acl->oplog.count; i++) {
+		ok = acl_file_write(file, acl_oplog_at(&acl->oplog, i),
+			sizeof(struct acl_op));
+	}
+	if (fs_close(file) != 0) {
+		ok = false;
+	}
+
+	// the old file and the journal still hold everything; keep them
+	if (!ok) {
+		fprintf(stderr, "[ACL] Failed to write '%s'.\n", tmp_path);
+		fs_remove(tmp_path);
+		return;
+	}
+	if (fs_rename(tmp_path, acl->file_path) != 0) {
+		fprintf(stderr, "[ACL] Failed to replace '%s'.\n",
+			acl->file_path);
+		fs_remove(tmp_path);
+		return;
+	}
+	acl->epoch = header.epoch;
+
+	char journal_path[ACL_PATH_LENGTH];
+	if (acl_journal_path(acl, journal_path, sizeof(journal_path))) {
+		fs_close(fs_open(journal_path,
+			FS_O_WRONLY | FS_O_CREAT | FS_O_TRUNC));
+	}
+	acl->journal_count = 0;
+#else
+	(void)acl;
+#endif
+}
+
+/*
+ * Use `image` as the read-only bulk of the list. Users that are also in the
+ * image are dropped from the in-RAM list; removing an image member only sets
+ * its revoked bit, and acl_save() stores it after the users.
+ */
+void acl_attach_image(
+	struct access_control_list *acl, const struct acl_image *image)
+{
+	free(acl->revoked);
+	acl->revoked = NULL;
+	acl->image = NULL;
+	bool writable = acl_make_writable(acl);
+
+	if (image && image->header) {
+		size_t count = acl_image_user_count(image);
+		acl->revoked = calloc(acl_revoked_size(image), 1);
+		if (!acl->revoked) {
+			fprintf(stderr, "[ACL] No memory to attach image.\n");
+			acl_rehash(acl);
+			return;
+		}
+		acl->image = image;
+		printf("[ACL] Attached image with %zu users.\n", count);
+	}
+	if (!writable) {
+		acl_rehash(acl);
+		return;
+	}
+
+	size_t n = 0;
+	for (size_t i = 0; i < acl->user_count; i++) {
+		if (acl->image
+			&& acl_image_lookup(acl->image, &acl->users[i], NULL)) {
+			continue;
+		}
+		acl->users[n++] = acl->users[i];
+	}
+	acl->user_count = n;
+
+	acl_rehash(acl);
+}
+
+/*
+ * The list is kept sorted, so this returns the index of the first user that
+ * compares greater than or equal to `user`.
+ */
+static size_t acl_lower_bound(
+	struct access_control_list *acl, const struct uid *user)
+{
+	return acl_list_lower_bound(acl->users, acl->user_count, user);
+}
+
+static bool acl_is_member(
+	struct access_control_list *acl, const struct uid *user)
+{
+	size_t slot;
+	if (acl_image_has(acl, user, &slot)) {
+		return true;
+	}
+
+	// UIDs are normalized when they come in, see uid_normalize()
+	return acl_list_contains(acl->users, acl->user_count, user);
+}
+
+/*
+ * Whether `user` may use this reader's door, see acl_set_door().
+ */
+bool acl_has_user(struct access_control_list *acl, const struct uid *user)
+{
+	if (!acl_is_member(acl, user)) {
+		return false;
+	}
+	return acl_user_doors(acl, user) & (1u << acl->door);
+}
+
+/*
+ * Add `schedule` to the ACL's table, or find the identical one already
+ * there. A full table reuses a schedule that no member refers to anymore.
+ * Returns the schedule ID to pass to acl_set_schedule(), or -1 if the table
+ * is full.
+ *
+ * A schedule is too big for a journal record, so a new one saves the whole
+ * list; the journaled assignments that refer to it come after that save.
+ */
+int acl_schedule_add(
+	struct access_control_list *acl, const struct acl_schedule *schedule)
+{
+	for (size_t i = 0; i < acl->schedule_count; i++) {
+		if (memcmp(&acl->schedules[i], schedule, sizeof(*schedule))
+			== 0) {
+			return (int)i + 1;
+		}
+	}
+
+	size_t index = acl->schedule_count;
+	if (index == ACL_MAX_SCHEDULES) {
+		bool used[ACL_MAX_SCHEDULES] = {false};
+		for (size_t i = 0; i < acl->scheduled.count; i++) {
+			used[acl->scheduled.entries[i].value - 1] = true;
+		}
+		for (index = 0; index < ACL_MAX_SCHEDULES; index++) {
+			if (!used[index]) {
+				break;
+			}
+		}
+		if (index == ACL_MAX_SCHEDULES) {
+			fprintf(stderr, "[ACL] Schedule table is full.\n");
+			return -1;
+		}
+	} else {
+		acl->schedule_count++;
+	}
+
+	acl->schedules[index] = *schedule;
+	acl->schedule_hashes[index] = acl_schedule_hash(schedule);
+	acl_save(acl);
+	return (int)index + 1;
+}
+
+/*
+ * Set one of member `user`'s attributes. The digest depends on them, so the
+ * member is taken out of the hash and put back with the new value.
+ * Returns 1 if the value changed, 0 if it was already set and -1 if `user`
+ * is not a member or there is no memory for it.
+ */
+static int acl_update_attr(struct access_control_list *acl,
+	struct acl_attr_table *table, const struct uid *user, uint8_t value,
+	uint8_t fallback)
 {
-	size_t pos = 0;
-	while (pos < (max_len - 1)) {
-		char c;
-		size_t bytes_read = fs_read_data(file, &c, 1);
+	if (!acl_is_member(acl, user)) {
+		return -1;
+	}
+	if (acl_attr_get(table, user, fallback) == value) {
+		return 0;
+	}
 
-		if (bytes_read == 0) {
-			// EOF reached
-			break;
-		}
+	if (value != fallback && !acl_attr_reserve(table, table->count + 1)) {
+		fprintf(stderr, "[ACL] No memory to update member.\n");
+		return -1;
+	}
 
-		if (c == '\n') {
-			break;
+	acl_hash_remove(acl, user);
+	acl_attr_set(table, user, value, fallback);
+	acl_hash_add(acl, user);
+	return 1;
+}
+
+/*
+ * Apply `op` to the list, without logging it anywhere. Returns 1 if the
+ * list changed, 0 if it already matched and -1 if the op can't be applied.
+ */
+static int acl_change(
+	struct access_control_list *acl, const struct acl_op *op)
+{
+	switch (op->type) {
+	case ACL_OP_ADD:
+		return acl_add_user(acl, &op->user);
+	case ACL_OP_REMOVE:
+		return acl_drop_user(acl, &op->user);
+	case ACL_OP_SCHEDULE:
+		if (op->value > acl->schedule_count) {
+			return -1;
 		}
+		return acl_update_attr(acl, &acl->scheduled, &op->user,
+			op->value, ACL_SCHEDULE_ALWAYS);
+	case ACL_OP_DOORS:
+		return acl_update_attr(acl, &acl->doors, &op->user, op->value,
+			ACL_DOORS_ALL);
+	default:
+		return -1;
+	}
+}
+
+/*
+ * Apply a local change, one that didn't come with a generation, and
+ * journal it. Returns the result of acl_change().
+ */
+static int acl_change_local(struct access_control_list *acl, uint8_t type,
+	const struct uid *user, uint8_t value)
+{
+	struct acl_op op;
+	memset(&op, 0, sizeof(op));
+	op.type = type;
+	op.value = value;
+	op.user = *user;
 
-		buffer[pos++] = c;
+	int status = acl_change(acl, &op);
+	if (status > 0) {
+		acl_journal_append(acl, &op, false);
 	}
+	return status;
+}
 
-	buffer[pos] = '\0';
-	return pos;
+static int acl_set_attr(struct access_control_list *acl, uint8_t type,
+	const struct uid *user, uint8_t value)
+{
+	return acl_change_local(acl, type, user, value) < 0 ? -1 : 0;
 }
-#endif
 
-void acl_load(struct access_control_list *acl, const char *file_path)
+/*
+ * Give member `user` schedule `schedule`, an ID from acl_schedule_add() or
+ * ACL_SCHEDULE_ALWAYS. Returns 0 on success, -1 if `user` is not a member or
+ * the schedule doesn't exist.
+ */
+int acl_set_schedule(struct access_control_list *acl,
+	const struct uid *user, uint8_t schedule)
 {
-#if WITH_FS
-	acl->file_path = file_path;
-	acl->user_count = 0;
+	if (schedule > acl->schedule_count) {
+		return -1;
+	}
+	return acl_set_attr(acl, ACL_OP_SCHEDULE, user, schedule);
+}
 
-	File file = fs_open(file_path, FS_O_RDONLY);
+uint8_t acl_user_schedule(
+	struct access_control_list *acl, const struct uid *user)
+{
+	return acl_attr_get(&acl->scheduled, user, ACL_SCHEDULE_ALWAYS);
+}
 
-	char line[USER_MAX_LENGTH];
-	while (true) {
-		size_t len = fs_read_line(file, line, sizeof(line));
-		if (len == 0) {
-			break;
-		}
+/*
+ * Let member `user` through the doors in bitmask `doors` only.
+ * Returns 0 on success, -1 if `user` is not a member.
+ */
+int acl_set_doors(struct access_control_list *acl, const struct uid *user,
+	uint8_t doors)
+{
+	return acl_set_attr(acl, ACL_OP_DOORS, user, doors);
+}
 
-		if (len > 0 && line[len - 1] == '\r') {
-			line[len - 1] = '\0';
-		}
+uint8_t acl_user_doors(
+	struct access_control_list *acl, const struct uid *user)
+{
+	return acl_attr_get(&acl->doors, user, ACL_DOORS_ALL);
+}
 
-		if (acl->user_count < MAX_USERS) {
-			strncpy(acl->users[acl->user_count], line,
-				USER_MAX_LENGTH - 1);
-			acl->users[acl->user_count][USER_MAX_LENGTH - 1] = '\0';
-			acl->user_count++;
-		} else {
-			fprintf(stderr, "[ACL] Maximum user limit reached.\n");
-			break;
+/*
+ * Choose which door this reader guards, 0 to ACL_DOORS - 1: its bit in the
+ * members' door masks. The door is a setting of the device, not part of the
+ * list, so it is neither saved nor hashed. Returns -1 for a door outside
+ * that range, and keeps the current one.
+ */
+int acl_set_door(struct access_control_list *acl, uint8_t door)
+{
+	if (door >= ACL_DOORS) {
+		fprintf(stderr, "[ACL] No door %u; doors are 0 to %d.\n",
+			(unsigned)door, ACL_DOORS - 1);
+		return -1;
+	}
+	acl->door = door;
+	return 0;
+}
+
+/*
+ * Apply an op from the server. Only the op after the current generation is
+ * applied; older ones are already in the list. Returns 1 if `op` was
+ * applied, 0 if it is old, and -1 if it is ahead of the list or can't be
+ * applied: the caller should then ask for the ops after acl_generation(),
+ * or for a full sync if those are gone.
+ */
+int acl_apply_op(struct access_control_list *acl, const struct acl_op *op)
+{
+	uint32_t generation = acl->oplog.generation;
+	if (op->generation <= generation) {
+		return 0;
+	}
+	if (op->generation != generation + 1 || acl_change(acl, op) < 0) {
+		return -1;
+	}
+
+	acl_oplog_push(&acl->oplog, op);
+	acl_journal_append(acl, op, true);
+	return 1;
+}
+
+/*
+ * The generation of the last op from the server that the list reflects.
+ */
+uint32_t acl_generation(struct access_control_list *acl)
+{
+	return acl->oplog.generation;
+}
+
+/*
+ * Mark the list as matching the server's `generation`, after a full sync.
+ * The op log starts over from there.
+ */
+void acl_set_generation(
+	struct access_control_list *acl, uint32_t generation)
+{
+	acl_oplog_reset(&acl->oplog, generation);
+	acl_save(acl);
+}
+
+/*
+ * Start replacing the whole list with a snapshot from the server. Every
+ * member is dropped, image members included, along with the schedules;
+ * acl_snapshot_user() and friends fill the list in again, and
+ * acl_set_generation() saves it. Nothing is journaled in between.
+ */
+void acl_snapshot_begin(struct access_control_list *acl)
+{
+	acl_clear(acl);
+	if (acl->image) {
+		size_t count = acl_image_user_count(acl->image);
+		for (size_t slot = 0; slot < count; slot++) {
+			acl_set_revoked(acl, slot, true);
 		}
 	}
+	acl_rehash(acl);
+}
 
-	fs_close(file);
-#endif
+/*
+ * Add one member of the snapshot. Members coming in sorted order are
+ * appended without moving the rest of the list.
+ * Returns 0 on success, -1 if there is no room for `user`.
+ */
+int acl_snapshot_user(struct access_control_list *acl, const struct uid *user)
+{
+	return acl_add_user(acl, user) < 0 ? -1 : 0;
 }
 
-void acl_save(struct access_control_list *acl)
+/*
+ * Add the next schedule of the snapshot; the first one added is ID 1.
+ * Returns 0 on success, -1 if the table is full.
+ */
+int acl_snapshot_schedule(
+	struct access_control_list *acl, const struct acl_schedule *schedule)
 {
-#if WITH_FS
-	File file =
-		fs_open(acl->file_path, FS_O_WRONLY | FS_O_CREAT | FS_O_TRUNC);
-#ifdef __PICO_BUILD__
-	if (!file.handle) {
-#else
-	if (file.fd < 0) {
-#endif
-		fprintf(stderr, "[ACL] Failed to open file '%s' for writing.\n",
-			acl->file_path);
-		return;
+	if (acl->schedule_count == ACL_MAX_SCHEDULES) {
+		return -1;
 	}
 
-	for (size_t i = 0; i < acl->user_count; i++) {
-		size_t len = strnlen(acl->users[i], USER_MAX_LENGTH);
+	acl->schedules[acl->schedule_count] = *schedule;
+	acl->schedule_hashes[acl->schedule_count] =
+		acl_schedule_hash(schedule);
+	acl->schedule_count++;
+	return 0;
+}
 
-		if (len > 0) {
-			if (fs_write_data(file, acl->users[i], len) != len) {
-				fprintf(stderr,
-					"[acl_save] Write error at user %zu\n",
-					i);
-				break;
-			}
-		}
+/*
+ * Give a member added with acl_snapshot_user() its schedule and door mask.
+ * Returns 0 on success, -1 if `user` is not a member, the schedule doesn't
+ * exist or there is no memory for it.
+ */
+int acl_snapshot_attrs(struct access_control_list *acl,
+	const struct uid *user, uint8_t schedule, uint8_t doors)
+{
+	if (schedule > acl->schedule_count) {
+		return -1;
+	}
+	int status = acl_update_attr(
+		acl, &acl->scheduled, user, schedule, ACL_SCHEDULE_ALWAYS);
+	if (status >= 0) {
+		status = acl_update_attr(
+			acl, &acl->doors, user, doors, ACL_DOORS_ALL);
+	}
+	return status < 0 ? -1 : 0;
+}
 
-		if (fs_write_data(file, "\n", 1) != 1) {
-			fprintf(stderr,
-				"[acl_save] Failed to write newline for user "
-				"%zu\n",
-				i);
-			break;
-		}
+/*
+ * Whether `user` may enter during week slot `slot`, see acl_schedule_slot().
+ */
+bool acl_user_allowed(struct access_control_list *acl,
+	const struct uid *user, unsigned slot)
+{
+	if (!acl_has_user(acl, user)) {
+		return false;
 	}
 
-	fs_close(file);
-#endif
+	uint8_t schedule = acl_user_schedule(acl, user);
+	if (schedule == ACL_SCHEDULE_ALWAYS) {
+		return true;
+	}
+	return acl_schedule_allows(
+		&acl->schedules[schedule - 1], slot % ACL_SCHEDULE_SLOTS);
 }
 
-bool acl_has_user(struct access_control_list *acl, const char *user)
+/*
+ * LSD radix sort over the bytes of struct uid, last byte first. Every pass is
+ * a stable counting sort, so after the final pass (the length tag) the list
+ * is in uid_compare() order. Time is O(n) per pass regardless of the input
+ * order, and there is no recursion. `scratch` must hold `n` entries.
+ *
+ * The 1 KiB of counts is on the stack rather than static, so two lists can
+ * be sorted at once.
+ */
+static void radix_sort_users(struct uid *users, size_t n, struct uid *scratch)
 {
-	for (size_t i = 0; i < acl->user_count; i++) {
-		/*
-		 * we may need additional logic here because of the way the
-		 * previous rfid reader handled bytes that started with 0 (hex
-		 * notation) in the UID
-		 * */
-		if (strcmp(acl->users[i], user) == 0) {
-			return true;
+	uint32_t counts[256];
+	struct uid *src = users;
+	struct uid *dst = scratch;
+
+	for (size_t byte = sizeof(struct uid); byte-- > 0;) {
+		memset(counts, 0, sizeof(counts));
+		for (size_t i = 0; i < n; i++) {
+			counts[((const uint8_t *)&src[i])[byte]]++;
+		}
+
+		// Skip the pass if every key has the same byte here
+		if (counts[((const uint8_t *)&src[0])[byte]] == n) {
+			continue;
+		}
+
+		uint32_t offset = 0;
+		for (size_t b = 0; b < 256; b++) {
+			uint32_t count = counts[b];
+			counts[b] = offset;
+			offset += count;
+		}
+
+		for (size_t i = 0; i < n; i++) {
+			uint8_t key = ((const uint8_t *)&src[i])[byte];
+			dst[counts[key]++] = src[i];
 		}
+
+		struct uid *tmp = src;
+		src = dst;
+		dst = tmp;
+	}
+
+	if (src != users) {
+		memcpy(users, src, n * sizeof(struct uid));
 	}
-	return false;
 }
 
-#define rotl1(x) (((x) << 1) | ((x) >> 31))
-char sorted_users[MAX_USERS][USER_MAX_LENGTH];
+/* a UID in acl_has_users_batch() and where its answer goes */
+struct acl_query {
+	struct uid user;
+	uint32_t index;
+};
 
-int partition(char users[][USER_MAX_LENGTH], int low, int high)
+/*
+ * radix_sort_users() for queries. The counts are on the stack, since
+ * lookups run on several threads at once.
+ */
+static void radix_sort_queries(
+	struct acl_query *queries, size_t n, struct acl_query *scratch)
 {
-	char pivot[USER_MAX_LENGTH];
-	strncpy(pivot, users[high], USER_MAX_LENGTH);
+	uint32_t counts[256];
+	struct acl_query *src = queries;
+	struct acl_query *dst = scratch;
 
-	int i = low - 1;
-	for (int j = low; j < high; j++) {
-		if (strcmp(users[j], pivot) <= 0) {
-			i++;
-			char temp[USER_MAX_LENGTH];
-			strncpy(temp, users[i], USER_MAX_LENGTH);
-			strncpy(users[i], users[j], USER_MAX_LENGTH);
-			strncpy(users[j], temp, USER_MAX_LENGTH);
+	for (size_t byte = sizeof(struct uid); byte-- > 0;) {
+		memset(counts, 0, sizeof(counts));
+		for (size_t i = 0; i < n; i++) {
+			counts[((const uint8_t *)&src[i].user)[byte]]++;
+		}
+
+		if (counts[((const uint8_t *)&src[0].user)[byte]] == n) {
+			continue;
+		}
+
+		uint32_t offset = 0;
+		for (size_t b = 0; b < 256; b++) {
+			uint32_t count = counts[b];
+			counts[b] = offset;
+			offset += count;
+		}
+
+		for (size_t i = 0; i < n; i++) {
+			uint8_t key = ((const uint8_t *)&src[i].user)[byte];
+			dst[counts[key]++] = src[i];
 		}
+
+		struct acl_query *tmp = src;
+		src = dst;
+		dst = tmp;
 	}
 
-	char temp[USER_MAX_LENGTH];
-	strncpy(temp, users[i + 1], USER_MAX_LENGTH);
-	strncpy(users[i + 1], users[high], USER_MAX_LENGTH);
-	strncpy(users[high], temp, USER_MAX_LENGTH);
+	if (src != queries) {
+		memcpy(queries, src, n * sizeof(struct acl_query));
+	}
+}
 
-	return i + 1;
+/*
+ * Drop adjacent duplicates from a sorted array and return the new length.
+ */
+static size_t unique_users(struct uid *users, size_t count)
+{
+	size_t n = 0;
+	for (size_t i = 0; i < count; i++) {
+		if (n > 0 && uid_equal(&users[n - 1], &users[i])) {
+			continue;
+		}
+		if (n != i) {
+			users[n] = users[i];
+		}
+		n++;
+	}
+	return n;
 }
 
-void quick_sort_users(char users[][USER_MAX_LENGTH], int low, int high)
+#if WITH_FS
+/*
+ * Fallback for when there is no memory for the radix sort scratch buffer.
+ */
+static void insertion_sort_users(struct uid *users, size_t n)
 {
-	if (low < high) {
-		int pivot_index = partition(users, low, high);
-		quick_sort_users(users, low, pivot_index - 1);
-		quick_sort_users(users, pivot_index + 1, high);
+	for (size_t i = 1; i < n; i++) {
+		struct uid key = users[i];
+		size_t j = i;
+		while (j > 0 && uid_compare(&users[j - 1], &key) > 0) {
+			users[j] = users[j - 1];
+			j--;
+		}
+		users[j] = key;
 	}
 }
 
-void quick_sort_users_in_place(struct access_control_list *acl)
+static void acl_sort_users(struct access_control_list *acl)
 {
-	if (!acl || acl->user_count <= 1) {
+	if (acl->user_count <= 1) {
+		return;
+	}
+
+	// Prefer the free end of the arena for scratch space
+	size_t size = acl->user_count * sizeof(struct uid);
+	struct uid *scratch = arena_tail(&acl->arena, size);
+	if (scratch) {
+		radix_sort_users(acl->users, acl->user_count, scratch);
+		return;
+	}
+
+	scratch = malloc(size);
+	if (!scratch) {
+		fprintf(stderr, "[ACL] No memory for sort buffer, using "
+				"insertion sort.\n");
+		insertion_sort_users(acl->users, acl->user_count);
 		return;
 	}
-	quick_sort_users(acl->users, 0, acl->user_count - 1);
+
+	radix_sort_users(acl->users, acl->user_count, scratch);
+	free(scratch);
 }
 
 /*
- * dbj2: http://www.cse.yorku.ca/~oz/hash.html
+ * Restore the sorted invariant after a bulk load and drop any duplicates.
  */
-static uint32_t hash_string(const char *str, uint32_t hash)
+static void acl_sort_unique(struct access_control_list *acl)
 {
-	while (*str) {
-		hash = ((hash << 5) + hash) + (unsigned char)(*str);
-		str++;
-	}
-	return hash = ((hash << 5) + hash) + 0xFE;
+	acl_sort_users(acl);
+	acl->user_count = unique_users(acl->users, acl->user_count);
 }
+#endif
 
-uint32_t acl_hash(struct access_control_list *acl)
+/*
+ * Recompute the hash and bucket hashes from scratch: the image users that
+ * haven't been revoked plus the users in RAM.
+ */
+static void acl_rehash(struct access_control_list *acl)
 {
-	quick_sort_users_in_place(acl);
+	acl->hash = 0;
+	memset(acl->buckets, 0, sizeof(acl->buckets));
+
+	if (acl->image) {
+		size_t count = acl_image_user_count(acl->image);
+		uint32_t image_hash = 0;
+		for (size_t slot = 0; slot < count; slot++) {
+			image_hash += uid_hash(&acl->image->slots[slot], 0);
+			acl_hash_add(acl, &acl->image->slots[slot]);
+		}
+		if (image_hash != acl->image->header->acl_hash) {
+			fprintf(stderr, "[ACL] Image hash mismatch.\n");
+		}
+		for (size_t slot = 0; slot < count; slot++) {
+			if (acl_slot_revoked(acl, slot)) {
+				acl_hash_remove(acl, &acl->image->slots[slot]);
+			}
+		}
+	}
 
-	uint32_t hash = 5381;
 	for (size_t i = 0; i < acl->user_count; i++) {
-		const char *str = acl->users[i];
-		hash = hash_string(str, hash);
+		acl_hash_add(acl, &acl->users[i]);
 	}
-	return hash;
+}
+
+uint32_t acl_hash(struct access_control_list *acl)
+{
+	return acl->hash;
 }
 
 void acl_print(struct access_control_list *acl)
 {
 	printf("[ACL] Contents of Access Control List:\n");
 	for (size_t i = 0; i < acl->user_count; i++) {
-		printf("  User %zu: %s\n", i + 1, acl->users[i]);
+		char hex[UID_HEX_LENGTH];
+		uid_to_hex(&acl->users[i], hex);
+		printf("  User %zu: %s\n", i + 1, hex);
 	}
-	printf("[ACL] Total Users: %zu\n", acl->user_count);
+	size_t image_count = 0;
+	if (acl->image) {
+		for (size_t slot = 0; slot < acl_image_user_count(acl->image);
+			slot++) {
+			if (!acl_slot_revoked(acl, slot)) {
+				image_count++;
+			}
+		}
+		printf("[ACL] Image Users: %zu\n", image_count);
+	}
+	printf("[ACL] Total Users: %zu\n", acl->user_count + image_count);
 }
 
-void acl_append_user(struct access_control_list *acl, const char *user)
+/*
+ * Returns 1 if `user` was added, 0 if it was already in the list and -1 if
+ * there is no room for it.
+ */
+static int acl_add_user(
+	struct access_control_list *acl, const struct uid *user)
 {
-	if (acl->user_count >= MAX_USERS) {
-		fprintf(stderr,
-			"[ACL] Cannot append user. Maximum user limit "
-			"reached.\n");
-		return;
+	size_t slot;
+	if (acl->image && acl_image_lookup(acl->image, user, &slot)) {
+		if (!acl_slot_revoked(acl, slot)) {
+			return 0;
+		}
+		acl_set_revoked(acl, slot, false);
+		acl_hash_add(acl, user);
+		return 1;
 	}
 
-	if (acl_has_user(acl, user)) {
-		printf("[ACL] User '%s' already exists in the list.\n", user);
-		return;
+	size_t i = acl_lower_bound(acl, user);
+	if (i < acl->user_count && uid_equal(&acl->users[i], user)) {
+		return 0;
+	}
+
+	if (!acl_make_writable(acl) || !acl_reserve(acl, acl->user_count + 1)) {
+		return -1;
 	}
 
-	strncpy(acl->users[acl->user_count], user, USER_MAX_LENGTH - 1);
-	acl->users[acl->user_count][USER_MAX_LENGTH - 1] = '\0';
+	// Shift everything from i down one to keep the list sorted
+	memmove(&acl->users[i + 1], &acl->users[i],
+		(acl->user_count - i) * sizeof(struct uid));
+	acl->users[i] = *user;
 	acl->user_count++;
+	acl_hash_add(acl, user);
+	return 1;
+}
+
+/*
+ * Returns 1 if `user` was removed, 0 if it wasn't in the list and -1 if the
+ * list couldn't be changed.
+ */
+static int acl_drop_user(
+	struct access_control_list *acl, const struct uid *user)
+{
+	size_t slot;
+	if (acl_image_has(acl, user, &slot)) {
+		acl_set_revoked(acl, slot, true);
+		acl_hash_remove(acl, user);
+		acl_forget_user(acl, user);
+		return 1;
+	}
+
+	size_t i = acl_lower_bound(acl, user);
+	if (i >= acl->user_count || !uid_equal(&acl->users[i], user)) {
+		return 0;
+	}
+	if (!acl_make_writable(acl)) {
+		return -1;
+	}
+
+	// Shift everything after i up one
+	memmove(&acl->users[i], &acl->users[i + 1],
+		(acl->user_count - i - 1) * sizeof(struct uid));
+	acl->user_count--;
+	acl_hash_remove(acl, user);
+	acl_forget_user(acl, user);
+	return 1;
+}
+
+void acl_append_user(struct access_control_list *acl, const struct uid *user)
+{
+	char hex[UID_HEX_LENGTH];
+	uid_to_hex(user, hex);
+
+	int status = acl_change_local(acl, ACL_OP_ADD, user, 0);
+	if (status == 0) {
+		printf("[ACL] User '%s' already exists in the list.\n", hex);
+	} else if (status < 0) {
+		fprintf(stderr,
+			"[ACL] Cannot append user. ACL arena is full.\n");
+	}
+}
+
+void acl_remove_user(struct access_control_list *acl, const struct uid *user)
+{
+	char hex[UID_HEX_LENGTH];
+	uid_to_hex(user, hex);
+
+	int status = acl_change_local(acl, ACL_OP_REMOVE, user, 0);
+	if (status == 0) {
+		printf("[ACL] User '%s' not found in the list.\n", hex);
+	} else if (status > 0) {
+		printf("[ACL] User '%s' removed successfully.\n", hex);
+	}
+}
+
+/*
+ * Add or remove a UID given in hex, as received over MQTT. The UID is
+ * normalized first, so legacy forms match the stored member.
+ * Returns 0 on success, -1 if `hex` is not a valid UID.
+ */
+int acl_append_hex(struct access_control_list *acl, const char *hex)
+{
+	struct uid uid;
+	if (uid_from_hex(&uid, hex) != 0) {
+		fprintf(stderr, "[ACL] Invalid UID '%s'.\n", hex);
+		return -1;
+	}
+	acl_append_user(acl, &uid);
+	return 0;
+}
+
+int acl_remove_hex(struct access_control_list *acl, const char *hex)
+{
+	struct uid uid;
+	if (uid_from_hex(&uid, hex) != 0) {
+		fprintf(stderr, "[ACL] Invalid UID '%s'.\n", hex);
+		return -1;
+	}
+	acl_remove_user(acl, &uid);
+	return 0;
 }
 
-void acl_remove_user(struct access_control_list *acl, const char *user)
+/*
+ * Apply many adds and removes at once. The batch is sorted and merged into
+ * the sorted list in a single linear pass for the removes and a single
+ * backward pass for the adds, then saved once. Removes are applied before
+ * adds, so a UID in both lists ends up in the ACL.
+ *
+ * Returns 0 on success, -1 if the batch couldn't be applied in full.
+ */
+int acl_apply_batch(struct access_control_list *acl, const struct uid *adds,
+	size_t add_count, const struct uid *removes, size_t remove_count)
 {
+	size_t total = add_count + remove_count;
+	if (total == 0) {
+		return 0;
+	}
+	if (!acl_make_writable(acl)) {
+		return -1;
+	}
+
+	// Sorted copies of both lists, plus scratch space for the radix sort
+	struct uid *buffer = malloc(2 * total * sizeof(struct uid));
+	if (!buffer) {
+		fprintf(stderr, "[ACL] No memory to apply batch.\n");
+		return -1;
+	}
+	struct uid *add = buffer;
+	struct uid *remove = buffer + add_count;
+	struct uid *scratch = buffer + total;
+
+	memcpy(add, adds, add_count * sizeof(struct uid));
+	memcpy(remove, removes, remove_count * sizeof(struct uid));
+	radix_sort_users(add, add_count, scratch);
+	radix_sort_users(remove, remove_count, scratch);
+	add_count = unique_users(add, add_count);
+	remove_count = unique_users(remove, remove_count);
+
+	size_t added = 0;
+	size_t removed = 0;
+	size_t slot;
+
+	// Removes: one merge pass compacts the list in place
+	size_t r = 0;
+	size_t n = 0;
 	for (size_t i = 0; i < acl->user_count; i++) {
-		if (strcmp(acl->users[i], user) == 0) {
-			// Shift everything after i up one
-			for (size_t j = i; j < acl->user_count - 1; j++) {
-				strncpy(acl->users[j], acl->users[j + 1],
-					USER_MAX_LENGTH);
+		while (r < remove_count
+			&& uid_compare(&remove[r], &acl->users[i]) < 0) {
+			r++;
+		}
+		if (r < remove_count
+			&& uid_equal(&remove[r], &acl->users[i])) {
+			acl_hash_remove(acl, &acl->users[i]);
+			acl_forget_user(acl, &acl->users[i]);
+			removed++;
+			continue;
+		}
+		acl->users[n++] = acl->users[i];
+	}
+	acl->user_count = n;
+
+	for (r = 0; r < remove_count; r++) {
+		if (acl_image_has(acl, &remove[r], &slot)) {
+			acl_set_revoked(acl, slot, true);
+			acl_hash_remove(acl, &remove[r]);
+			acl_forget_user(acl, &remove[r]);
+			removed++;
+		}
+	}
+
+	// Adds: keep only the users that are new to the list
+	size_t new_count = 0;
+	size_t i = 0;
+	for (size_t a = 0; a < add_count; a++) {
+		if (acl->image
+			&& acl_image_lookup(acl->image, &add[a], &slot)) {
+			if (acl_slot_revoked(acl, slot)) {
+				acl_set_revoked(acl, slot, false);
+				acl_hash_add(acl, &add[a]);
+				added++;
 			}
-			acl->user_count--;
-			printf("[ACL] User '%s' removed successfully.\n", user);
-			return;
+			continue;
+		}
+
+		while (i < acl->user_count
+			&& uid_compare(&acl->users[i], &add[a]) < 0) {
+			i++;
+		}
+		if (i < acl->user_count
+			&& uid_equal(&acl->users[i], &add[a])) {
+			continue;
+		}
+		add[new_count++] = add[a];
+	}
+
+	int status = 0;
+	if (!acl_reserve(acl, acl->user_count + new_count)) {
+		fprintf(stderr,
+			"[ACL] Cannot apply adds. ACL arena is full.\n");
+		new_count = 0;
+		status = -1;
+	}
+
+	// Merge from the back so every user moves at most once
+	size_t src = acl->user_count;
+	size_t dst = acl->user_count + new_count;
+	size_t a = new_count;
+	while (a > 0) {
+		if (src > 0
+			&& uid_compare(&acl->users[src - 1], &add[a - 1]) > 0) {
+			acl->users[--dst] = acl->users[--src];
+		} else {
+			acl->users[--dst] = add[--a];
+			acl_hash_add(acl, &acl->users[dst]);
+		}
+	}
+	acl->user_count += new_count;
+	added += new_count;
+
+	free(buffer);
+
+	printf("[ACL] Batch applied: %zu added, %zu removed.\n", added,
+		removed);
+	acl_save(acl);
+	return status;
+}
+
+/*
+ * acl_has_user() for `n` UIDs at once, with the answer for in[i] stored in
+ * out[i]. The UIDs are sorted and walked in order alongside the list, each
+ * search galloping on from where the previous one ended, so a large batch
+ * costs about one pass over the list instead of n binary searches.
+ *
+ * Returns 0 on success, -1 if there is no memory for the batch.
+ */
+int acl_has_users_batch(struct access_control_list *acl,
+	const struct uid *in, size_t n, bool *out)
+{
+	if (n == 0) {
+		return 0;
+	}
+	if (n > UINT32_MAX) {
+		return -1;
+	}
+
+	struct acl_query *queries = malloc(2 * n * sizeof(struct acl_query));
+	if (!queries) {
+		fprintf(stderr, "[ACL] No memory for batch lookup.\n");
+		return -1;
+	}
+	for (size_t i = 0; i < n; i++) {
+		queries[i].user = in[i];
+		queries[i].index = (uint32_t)i;
+	}
+	radix_sort_queries(queries, n, queries + n);
+
+	size_t pos = 0;
+	for (size_t q = 0; q < n; q++) {
+		const struct uid *user = &queries[q].user;
+		pos = acl_list_gallop(acl->users, acl->user_count, pos, user);
+
+		size_t slot;
+		bool found = pos < acl->user_count
+			&& uid_equal(&acl->users[pos], user);
+		if (!found) {
+			found = acl_image_has(acl, user, &slot);
 		}
+		out[queries[q].index] = found
+			&& (acl_user_doors(acl, user) & (1u << acl->door));
 	}
-	printf("[ACL] User '%s' not found in the list.\n", user);
+
+	free(queries);
+	return 0;
 }
@@ -5,21 +5,135 @@
 #include <stddef.h>
 #include <stdint.h>
 
-#define USER_MAX_LENGTH 6 * 2
-#define MAX_USERS 1000
+#include "acl_attr.h"
+#include "acl_image.h"
+#include "acl_merkle.h"
+#include "acl_oplog.h"
+#include "acl_schedule.h"
+#include "arena.h"
+#include "sys/uid.h"
+
+/* RAM reserved for the in-RAM list when the ACL is initialized */
+#ifndef ACL_RAM_BUDGET
+#ifdef __PICO_BUILD__
+#define ACL_RAM_BUDGET (64 * 1024)
+#else
+#define ACL_RAM_BUDGET (4 * 1024 * 1024)
+#endif
+#endif
+
+/* the list grows by this many users at a time */
+#define ACL_GROW_USERS 64
+
+/*
+ * Members can be limited to some of up to 8 doors sharing one list. Each
+ * reader lets in the members whose door mask has its own ACL_DOOR bit set;
+ * members without a mask may use every door.
+ */
+#define ACL_DOORS 8
+#define ACL_DOORS_ALL 0xFF
+
+#ifndef ACL_DOOR
+#define ACL_DOOR 0
+#endif
+
+#if ACL_DOOR < 0 || ACL_DOOR >= ACL_DOORS
+#error "ACL_DOOR must be a door from 0 to 7"
+#endif
+
+/* the journal is compacted into a new snapshot after this many changes */
+#ifndef ACL_JOURNAL_COMPACT
+#define ACL_JOURNAL_COMPACT 256
+#endif
 
 struct access_control_list {
-	char users[MAX_USERS][USER_MAX_LENGTH];
+	struct arena arena;
+	struct uid *users;
 	size_t user_count;
+	size_t user_capacity;
+	/* sum of uid_hash(user, 0) over all users, see acl_hash() */
+	uint32_t hash;
+	/* the same sum split by acl_merkle_bucket(), see acl_merkle.h */
+	uint32_t buckets[ACL_MERKLE_BUCKETS];
+	/*
+	 * optional read-only image holding the bulk of the list, see
+	 * acl_attach_image(). `revoked` has one bit per image slot.
+	 */
+	const struct acl_image *image;
+	uint8_t *revoked;
+	/*
+	 * weekly schedules, see acl_schedule.h. schedules[id - 1] holds
+	 * schedule `id`; `scheduled` has the members that have one.
+	 */
+	struct acl_schedule schedules[ACL_MAX_SCHEDULES];
+	uint32_t schedule_hashes[ACL_MAX_SCHEDULES];
+	size_t schedule_count;
+	struct acl_attr_table scheduled;
+	/* door masks of the members not allowed through every door */
+	struct acl_attr_table doors;
+	/* this reader's door, see acl_set_door() */
+	uint8_t door;
+	/* generation of the list and the ops that led to it, see acl_oplog.h */
+	struct acl_oplog oplog;
+	/* set while `users` points into the mapped ACL file, see acl_load() */
+	const void *mapping;
+	size_t mapping_size;
 	const char *file_path;
+	/* changes appended to "<file_path>.log" since the last acl_save() */
+	size_t journal_count;
+	/* number of the last saved snapshot, see acl_journal_record */
+	uint32_t epoch;
 };
 
+int acl_init(struct access_control_list *acl, const char *file_path,
+	size_t ram_budget);
+void acl_free(struct access_control_list *acl);
+void acl_reset(struct access_control_list *acl);
+int acl_copy(struct access_control_list *dst,
+	const struct access_control_list *src);
 void acl_load(struct access_control_list *acl, const char *file_path);
 void acl_save(struct access_control_list *acl);
-void acl_append_user(struct access_control_list *acl, const char *user);
-void acl_remove_user(struct access_control_list *acl, const char *user);
-bool acl_has_user(struct access_control_list *acl, const char *user);
+void acl_attach_image(
+	struct access_control_list *acl, const struct acl_image *image);
+void acl_append_user(struct access_control_list *acl, const struct uid *user);
+void acl_remove_user(struct access_control_list *acl, const struct uid *user);
+int acl_append_hex(struct access_control_list *acl, const char *hex);
+int acl_remove_hex(struct access_control_list *acl, const char *hex);
+int acl_apply_batch(struct access_control_list *acl, const struct uid *adds,
+	size_t add_count, const struct uid *removes, size_t remove_count);
+bool acl_has_user(struct access_control_list *acl, const struct uid *user);
+int acl_has_users_batch(struct access_control_list *acl,
+	const struct uid *in, size_t n, bool *out);
+int acl_schedule_add(
+	struct access_control_list *acl, const struct acl_schedule *schedule);
+int acl_set_schedule(struct access_control_list *acl,
+	const struct uid *user, uint8_t schedule);
+uint8_t acl_user_schedule(
+	struct access_control_list *acl, const struct uid *user);
+int acl_set_doors(struct access_control_list *acl, const struct uid *user,
+	uint8_t doors);
+uint8_t acl_user_doors(
+	struct access_control_list *acl, const struct uid *user);
+int acl_set_door(struct access_control_list *acl, uint8_t door);
+int acl_apply_op(struct access_control_list *acl, const struct acl_op *op);
+uint32_t acl_generation(struct access_control_list *acl);
+void acl_set_generation(
+	struct access_control_list *acl, uint32_t generation);
+void acl_snapshot_begin(struct access_control_list *acl);
+int acl_snapshot_user(struct access_control_list *acl, const struct uid *user);
+int acl_snapshot_schedule(
+	struct access_control_list *acl, const struct acl_schedule *schedule);
+int acl_snapshot_attrs(struct access_control_list *acl,
+	const struct uid *user, uint8_t schedule, uint8_t doors);
+bool acl_user_allowed(struct access_control_list *acl,
+	const struct uid *user, unsigned slot);
 uint32_t acl_hash(struct access_control_list *acl);
 void acl_print(struct access_control_list *acl);
 
+static inline bool acl_slot_revoked(
+	const struct access_control_list *acl, size_t slot)
+{
+	return acl->revoked[slot / 8] & (1u << (slot % 8));
+}
+
 #endif // ACL_H
@@ -0,0 +1,127 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "acl_attr.h"
+
+/* the table grows by this many entries at a time */
+#define ACL_ATTR_GROW 16
+
+static size_t acl_attr_index(
+	const struct acl_attr_table *table, const struct uid *user)
+{
+	size_t lo = 0;
+	size_t hi = table->count;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (uid_compare(&table->entries[mid].user, user) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/*
+ * Value stored for `user`, or `fallback` if the table has none.
+ */
+uint8_t acl_attr_get(const struct acl_attr_table *table,
+	const struct uid *user, uint8_t fallback)
+{
+	if (table->count == 0) {
+		return fallback;
+	}
+
+	size_t i = acl_attr_index(table, user);
+	if (i < table->count && uid_equal(&table->entries[i].user, user)) {
+		return table->entries[i].value;
+	}
+	return fallback;
+}
+
+/*
+ * Store `value` for `user`. Setting the default `fallback` drops the entry.
+ * Returns 0 on success, -1 if there is no memory for a new entry.
+ */
+int acl_attr_set(struct acl_attr_table *table, const struct uid *user,
+	uint8_t value, uint8_t fallback)
+{
+	if (value == fallback) {
+		acl_attr_remove(table, user);
+		return 0;
+	}
+
+	size_t i = acl_attr_index(table, user);
+	if (i < table->count && uid_equal(&table->entries[i].user, user)) {
+		table->entries[i].value = value;
+		return 0;
+	}
+
+	if (!acl_attr_reserve(table, table->count + 1)) {
+		return -1;
+	}
+	memmove(&table->entries[i + 1], &table->entries[i],
+		(table->count - i) * sizeof(struct acl_attr));
+	table->entries[i].user = *user;
+	table->entries[i].value = value;
+	table->count++;
+	return 0;
+}
+
+void acl_attr_remove(struct acl_attr_table *table, const struct uid *user)
+{
+	if (table->count == 0) {
+		return;
+	}
+
+	size_t i = acl_attr_index(table, user);
+	if (i < table->count && uid_equal(&table->entries[i].user, user)) {
+		memmove(&table->entries[i], &table->entries[i + 1],
+			(table->count - i - 1) * sizeof(struct acl_attr));
+		table->count--;
+	}
+}
+
+bool acl_attr_reserve(struct acl_attr_table *table, size_t count)
+{
+	if (count <= table->capacity) {
+		return true;
+	}
+
+	size_t capacity = table->capacity + ACL_ATTR_GROW;
+	while (capacity < count) {
+		capacity += ACL_ATTR_GROW;
+	}
+	struct acl_attr *entries =
+		realloc(table->entries, capacity * sizeof(struct acl_attr));
+	if (!entries) {
+		return false;
+	}
+	table->entries = entries;
+	table->capacity = capacity;
+	return true;
+}
+
+/*
+ * Returns 0 on success, -1 if `dst` couldn't grow to hold `src`.
+ */
+int acl_attr_copy(
+	struct acl_attr_table *dst, const struct acl_attr_table *src)
+{
+	if (!acl_attr_reserve(dst, src->count)) {
+		return -1;
+	}
+	if (src->count) {
+		memcpy(dst->entries, src->entries,
+			src->count * sizeof(struct acl_attr));
+	}
+	dst->count = src->count;
+	return 0;
+}
+
+void acl_attr_free(struct acl_attr_table *table)
+{
+	free(table->entries);
+	memset(table, 0, sizeof(*table));
+}
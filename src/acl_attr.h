@@ -0,0 +1,37 @@
+#ifndef ACL_ATTR_H
+#define ACL_ATTR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sys/uid.h"
+
+/*
+ * A small per-member value (a schedule ID, a door mask) stored beside the
+ * list, only for the members whose value differs from the default. Entries
+ * are sorted by user, so a lookup is a binary search, and an empty table
+ * costs nothing: most members never appear in one.
+ */
+struct acl_attr {
+	struct uid user;
+	uint8_t value;
+};
+
+struct acl_attr_table {
+	struct acl_attr *entries;
+	size_t count;
+	size_t capacity;
+};
+
+uint8_t acl_attr_get(const struct acl_attr_table *table,
+	const struct uid *user, uint8_t fallback);
+int acl_attr_set(struct acl_attr_table *table, const struct uid *user,
+	uint8_t value, uint8_t fallback);
+void acl_attr_remove(struct acl_attr_table *table, const struct uid *user);
+bool acl_attr_reserve(struct acl_attr_table *table, size_t count);
+int acl_attr_copy(
+	struct acl_attr_table *dst, const struct acl_attr_table *src);
+void acl_attr_free(struct acl_attr_table *table);
+
+#endif // ACL_ATTR_H
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "acl_image.h"
+
+#include "fs.h"
+
+#ifdef __PICO_BUILD__
+#include "hardware/regs/addressmap.h"
+#include "pico/stdlib.h"
+#endif
+
+/*
+ * Validate the image at `data` and point `image` into it. Nothing is copied,
+ * so `data` has to stay mapped for as long as the image is in use.
+ * Returns 0 on success, -1 if the data is not a usable image.
+ */
+int acl_image_open(struct acl_image *image, const void *data, size_t size)
+{
+	const struct acl_image_header *header = data;
+
+	memset(image, 0, sizeof(*image));
+
+	if (!data || size < sizeof(*header)) {
+		return -1;
+	}
+	if (header->magic != ACL_IMAGE_MAGIC) {
+		return -1;
+	}
+	if (header->version != ACL_IMAGE_VERSION) {
+		fprintf(stderr, "[ACL] Unsupported image version %u.\n",
+			header->version);
+		return -1;
+	}
+	if (header->uid_bytes != UID_MAX_BYTES) {
+		fprintf(stderr,
+			"[ACL] Image was built for %u byte UIDs, expected "
+			"%u.\n",
+			header->uid_bytes, UID_MAX_BYTES);
+		return -1;
+	}
+	if (header->user_count > 0 && header->bucket_count == 0) {
+		return -1;
+	}
+
+	size_t needed = sizeof(*header)
+		+ (size_t)header->bucket_count * sizeof(uint32_t)
+		+ (size_t)header->user_count * sizeof(struct uid);
+	if (size < needed) {
+		fprintf(stderr, "[ACL] Image is truncated (%zu < %zu bytes).\n",
+			size, needed);
+		return -1;
+	}
+
+	image->header = header;
+	image->seeds = (const uint32_t *)(header + 1);
+	image->slots =
+		(const struct uid *)(image->seeds + header->bucket_count);
+	image->size = needed;
+	return 0;
+}
+
+#ifdef __PICO_BUILD__
+int acl_image_map(struct acl_image *image, const char *path)
+{
+	const void *data = (const void *)(XIP_BASE + ACL_IMAGE_FLASH_OFFSET);
+	return acl_image_open(image, data, ACL_IMAGE_FLASH_SIZE);
+}
+
+void acl_image_unmap(struct acl_image *image)
+{
+	memset(image, 0, sizeof(*image));
+}
+#else
+int acl_image_map(struct acl_image *image, const char *path)
+{
+	size_t size = 0;
+	const void *data = fs_map(path, &size);
+	if (!data) {
+		return -1;
+	}
+
+	if (acl_image_open(image, data, size) != 0) {
+		fs_unmap(data, size);
+		return -1;
+	}
+	image->size = size;
+	return 0;
+}
+
+void acl_image_unmap(struct acl_image *image)
+{
+	if (image->header) {
+		fs_unmap(image->header, image->size);
+	}
+	memset(image, 0, sizeof(*image));
+}
+#endif
+
+/*
+ * Look `user` up in the image. On a hit the slot index is stored in `slot`
+ * (if not NULL), which callers can use to keep per-entry state.
+ */
+bool acl_image_lookup(
+	const struct acl_image *image, const struct uid *user, size_t *slot)
+{
+	if (!image || !image->header || image->header->user_count == 0) {
+		return false;
+	}
+
+	const struct acl_image_header *header = image->header;
+	uint32_t bucket = uid_hash(user, 0) % header->bucket_count;
+	uint32_t index =
+		uid_hash(user, image->seeds[bucket]) % header->user_count;
+
+	if (!uid_equal(&image->slots[index], user)) {
+		return false;
+	}
+	if (slot) {
+		*slot = index;
+	}
+	return true;
+}
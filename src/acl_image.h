@@ -0,0 +1,65 @@
+#ifndef ACL_IMAGE_H
+#define ACL_IMAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sys/uid.h"
+
+/*
+ * A read-only ACL image built on the host by tools/acl_compiler.
+ *
+ * The image is a minimal perfect hash table over packed UIDs: a user is
+ * hashed to a bucket, the bucket's seed is used to hash it again to exactly
+ * one slot, and the slot is compared with the UID. Lookups are O(1) and the
+ * image is used where it lies (XIP flash on the Pico, an mmap on Linux)
+ * without copying it into RAM.
+ *
+ * Layout (little endian):
+ *   struct acl_image_header
+ *   uint32_t seeds[bucket_count]
+ *   struct uid slots[user_count]
+ */
+#define ACL_IMAGE_MAGIC 0x494c4341 // "ACLI"
+#define ACL_IMAGE_VERSION 1
+
+#ifdef __PICO_BUILD__
+/* by default the last 256 KiB of flash, written with `picotool load` */
+#ifndef ACL_IMAGE_FLASH_SIZE
+#define ACL_IMAGE_FLASH_SIZE (256 * 1024)
+#endif
+#ifndef ACL_IMAGE_FLASH_OFFSET
+#define ACL_IMAGE_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES - ACL_IMAGE_FLASH_SIZE)
+#endif
+#endif
+
+struct acl_image_header {
+	uint32_t magic;
+	uint16_t version;
+	uint8_t uid_bytes;
+	uint8_t reserved;
+	uint32_t user_count;
+	uint32_t bucket_count;
+	uint32_t acl_hash;
+};
+
+struct acl_image {
+	const struct acl_image_header *header;
+	const uint32_t *seeds;
+	const struct uid *slots;
+	size_t size;
+};
+
+int acl_image_open(struct acl_image *image, const void *data, size_t size);
+int acl_image_map(struct acl_image *image, const char *path);
+void acl_image_unmap(struct acl_image *image);
+bool acl_image_lookup(
+	const struct acl_image *image, const struct uid *user, size_t *slot);
+
+static inline size_t acl_image_user_count(const struct acl_image *image)
+{
+	return image->header->user_count;
+}
+
+#endif // ACL_IMAGE_H
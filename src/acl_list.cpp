@@ -0,0 +1,38 @@
+#include "acl_list.h"
+
+#include "access_key.hpp"
+
+/*
+ * A struct uid is compared as one key: the length byte followed by the
+ * zero padded UID. With the default UID_MAX_BYTES that is 8 bytes, so every
+ * compare in the list is a single 64-bit integer compare.
+ */
+using UidKey = AccessKey<sizeof(struct uid)>;
+
+static_assert(sizeof(struct uid) == UID_MAX_BYTES + 1,
+	"struct uid must not have padding");
+
+static const std::uint8_t *key_bytes(const struct uid *uid)
+{
+	return reinterpret_cast<const std::uint8_t *>(uid);
+}
+
+size_t acl_list_lower_bound(
+	const struct uid *users, size_t count, const struct uid *user)
+{
+	return UidKey::lower_bound(key_bytes(users), count, key_bytes(user));
+}
+
+bool acl_list_contains(
+	const struct uid *users, size_t count, const struct uid *user)
+{
+	size_t i = acl_list_lower_bound(users, count, user);
+	return i < count
+		&& UidKey::equal(key_bytes(&users[i]), key_bytes(user));
+}
+
+size_t acl_list_gallop(const struct uid *users, size_t count, size_t from,
+	const struct uid *user)
+{
+	return UidKey::gallop(key_bytes(users), count, from, key_bytes(user));
+}
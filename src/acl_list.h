@@ -0,0 +1,28 @@
+#ifndef ACL_LIST_H
+#define ACL_LIST_H
+
+#include <stddef.h>
+
+#include "sys/uid.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * C entry points into the AccessKey search helpers in access_key.hpp,
+ * specialized for struct uid. acl.c uses them for every search of the
+ * sorted list.
+ */
+size_t acl_list_lower_bound(
+	const struct uid *users, size_t count, const struct uid *user);
+bool acl_list_contains(
+	const struct uid *users, size_t count, const struct uid *user);
+size_t acl_list_gallop(const struct uid *users, size_t count, size_t from,
+	const struct uid *user);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ACL_LIST_H
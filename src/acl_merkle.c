@@ -0,0 +1,83 @@
+#include <stdio.h>
+
+#include "acl.h"
+#include "acl_merkle.h"
+
+/*
+ * Hash of an inner node: FNV-1a over the little endian bytes of the left
+ * and right child hashes, finished like uid_hash(). Unlike the bucket sums
+ * this is order dependent, so swapped subtrees don't compare equal.
+ */
+static uint32_t merkle_combine(uint32_t left, uint32_t right)
+{
+	uint32_t h = 2166136261u;
+
+	for (int i = 0; i < 4; i++) {
+		h = (h ^ ((left >> (i * 8)) & 0xFF)) * 16777619u;
+	}
+	for (int i = 0; i < 4; i++) {
+		h = (h ^ ((right >> (i * 8)) & 0xFF)) * 16777619u;
+	}
+
+	return uid_fmix32(h);
+}
+
+/*
+ * Hash of tree node `node`, see the numbering in acl_merkle.h.
+ * Returns 0 for a node outside the tree.
+ */
+uint32_t acl_merkle_node(struct access_control_list *acl, size_t node)
+{
+	if (node == 0 || node >= ACL_MERKLE_NODES) {
+		return 0;
+	}
+	if (node >= ACL_MERKLE_BUCKETS) {
+		return acl->buckets[node - ACL_MERKLE_BUCKETS];
+	}
+	return merkle_combine(acl_merkle_node(acl, node * 2),
+		acl_merkle_node(acl, node * 2 + 1));
+}
+
+uint32_t acl_merkle_root(struct access_control_list *acl)
+{
+	return acl_merkle_node(acl, 1);
+}
+
+/*
+ * Copy up to `max` users that fall in `bucket` into `out`.
+ * Returns the number of users in the bucket, which may be more than `max`.
+ */
+size_t acl_merkle_bucket_users(struct access_control_list *acl,
+	size_t bucket, struct uid *out, size_t max)
+{
+	size_t found = 0;
+
+	if (acl->image) {
+		size_t count = acl_image_user_count(acl->image);
+		for (size_t slot = 0; slot < count; slot++) {
+			const struct uid *user = &acl->image->slots[slot];
+			if (acl_slot_revoked(acl, slot)
+				|| acl_merkle_bucket(uid_hash(user, 0))
+					!= bucket) {
+				continue;
+			}
+			if (found < max) {
+				out[found] = *user;
+			}
+			found++;
+		}
+	}
+
+	for (size_t i = 0; i < acl->user_count; i++) {
+		const struct uid *user = &acl->users[i];
+		if (acl_merkle_bucket(uid_hash(user, 0)) != bucket) {
+			continue;
+		}
+		if (found < max) {
+			out[found] = *user;
+		}
+		found++;
+	}
+
+	return found;
+}
@@ -0,0 +1,39 @@
+#ifndef ACL_MERKLE_H
+#define ACL_MERKLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sys/uid.h"
+
+/*
+ * Users are split into ACL_MERKLE_BUCKETS buckets by the top bits of their
+ * digest. Each bucket's hash is the sum of its users' digests, so it is
+ * updated in O(1) alongside acl_hash(). A binary tree of the bucket hashes
+ * lets the server find the buckets that differ in ACL_MERKLE_DEPTH round
+ * trips and fetch only those, instead of resending the whole list.
+ *
+ * Nodes are numbered like a binary heap: 1 is the root, the children of n
+ * are 2n and 2n + 1, and the leaves are ACL_MERKLE_BUCKETS + bucket.
+ * tools/go_hasher has the reference implementation.
+ */
+#ifndef ACL_MERKLE_DEPTH
+#define ACL_MERKLE_DEPTH 6
+#endif
+
+#define ACL_MERKLE_BUCKETS (1u << ACL_MERKLE_DEPTH)
+#define ACL_MERKLE_NODES (2 * ACL_MERKLE_BUCKETS)
+
+struct access_control_list;
+
+static inline size_t acl_merkle_bucket(uint32_t digest)
+{
+	return digest >> (32 - ACL_MERKLE_DEPTH);
+}
+
+uint32_t acl_merkle_node(struct access_control_list *acl, size_t node);
+uint32_t acl_merkle_root(struct access_control_list *acl);
+size_t acl_merkle_bucket_users(struct access_control_list *acl,
+	size_t bucket, struct uid *out, size_t max);
+
+#endif // ACL_MERKLE_H
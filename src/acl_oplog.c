@@ -0,0 +1,63 @@
+#include "acl_oplog.h"
+
+/*
+ * Forget every op; the next one pushed is generation + 1.
+ */
+void acl_oplog_reset(struct acl_oplog *log, uint32_t generation)
+{
+	log->head = 0;
+	log->count = 0;
+	log->start = generation;
+	log->generation = generation;
+}
+
+/*
+ * Append `op`, dropping the oldest op once the ring is full. An op that
+ * doesn't follow the last one starts the ring over at its generation.
+ */
+void acl_oplog_push(struct acl_oplog *log, const struct acl_op *op)
+{
+	if (op->generation != log->generation + 1) {
+		acl_oplog_reset(log, op->generation - 1);
+	}
+
+	if (log->count == ACL_OPLOG_SIZE) {
+		log->head = (log->head + 1) % ACL_OPLOG_SIZE;
+		log->count--;
+		log->start++;
+	}
+	log->ops[(log->head + log->count) % ACL_OPLOG_SIZE] = *op;
+	log->count++;
+	log->generation = op->generation;
+}
+
+/*
+ * The `i`th oldest op, for i < log->count.
+ */
+const struct acl_op *acl_oplog_at(const struct acl_oplog *log, size_t i)
+{
+	return &log->ops[(log->head + i) % ACL_OPLOG_SIZE];
+}
+
+/*
+ * Copy up to `max` of the ops after `generation` to `out`, oldest first.
+ * Returns how many were copied, or -1 if the ring no longer reaches back to
+ * `generation` (or hasn't got there yet) and only a full sync will do.
+ */
+int acl_oplog_since(const struct acl_oplog *log, uint32_t generation,
+	struct acl_op *out, size_t max)
+{
+	if (generation < log->start || generation > log->generation) {
+		return -1;
+	}
+
+	size_t first = generation - log->start;
+	size_t count = log->count - first;
+	if (count > max) {
+		count = max;
+	}
+	for (size_t i = 0; i < count; i++) {
+		out[i] = *acl_oplog_at(log, first + i);
+	}
+	return (int)count;
+}
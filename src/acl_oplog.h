@@ -0,0 +1,53 @@
+#ifndef ACL_OPLOG_H
+#define ACL_OPLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sys/uid.h"
+
+/*
+ * Every change the server sends is an op numbered with the ACL generation
+ * it produces. Generations have no gaps, so a reader that has seen
+ * generation n only needs ops n + 1 onwards after a reconnect. The last
+ * ACL_OPLOG_SIZE ops are kept in a ring; a reader further behind than that
+ * needs a full sync.
+ */
+#ifndef ACL_OPLOG_SIZE
+#define ACL_OPLOG_SIZE 64
+#endif
+
+#define ACL_OP_ADD 1
+#define ACL_OP_REMOVE 2
+/* `value` is the member's schedule ID, see acl_set_schedule() */
+#define ACL_OP_SCHEDULE 3
+/* `value` is the member's door mask, see acl_set_doors() */
+#define ACL_OP_DOORS 4
+
+struct acl_op {
+	uint32_t generation;
+	uint8_t type;
+	uint8_t value;
+	uint8_t reserved[2];
+	struct uid user;
+};
+
+/*
+ * Holds the ops for generations start + 1 to generation, oldest at
+ * ops[head].
+ */
+struct acl_oplog {
+	struct acl_op ops[ACL_OPLOG_SIZE];
+	size_t head;
+	size_t count;
+	uint32_t start;
+	uint32_t generation;
+};
+
+void acl_oplog_reset(struct acl_oplog *log, uint32_t generation);
+void acl_oplog_push(struct acl_oplog *log, const struct acl_op *op);
+const struct acl_op *acl_oplog_at(const struct acl_oplog *log, size_t i);
+int acl_oplog_since(const struct acl_oplog *log, uint32_t generation,
+	struct acl_op *out, size_t max);
+
+#endif // ACL_OPLOG_H
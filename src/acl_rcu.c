@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "acl_rcu.h"
+
+/*
+ * Set up both snapshots. `ram_budget` is shared between them.
+ * Returns 0 on success, -1 if either arena couldn't be reserved.
+ */
+int acl_rcu_init(struct acl_rcu *rcu, const char *file_path,
+	size_t ram_budget)
+{
+	memset(rcu, 0, sizeof(*rcu));
+	atomic_init(&rcu->current, 0);
+	atomic_init(&rcu->readers[0], 0);
+	atomic_init(&rcu->readers[1], 0);
+	atomic_init(&rcu->queue_head, 0);
+	atomic_init(&rcu->queue_tail, 0);
+	atomic_init(&rcu->frame_head, 0);
+	atomic_init(&rcu->frame_tail, 0);
+
+	if (acl_init(&rcu->slots[0], file_path, ram_budget / 2) != 0) {
+		return -1;
+	}
+	if (acl_init(&rcu->slots[1], file_path, ram_budget / 2) != 0) {
+		acl_free(&rcu->slots[0]);
+		return -1;
+	}
+	return 0;
+}
+
+void acl_rcu_free(struct acl_rcu *rcu)
+{
+	acl_free(&rcu->slots[0]);
+	acl_free(&rcu->slots[1]);
+}
+
+/*
+ * Pin the published snapshot. The count is raised before checking that the
+ * snapshot is still current, so a writer that has already swapped past it
+ * either sees the reader or the reader sees the swap and tries again.
+ */
+struct access_control_list *acl_rcu_read_lock(struct acl_rcu *rcu)
+{
+	while (true) {
+		int i = atomic_load(&rcu->current);
+		atomic_fetch_add(&rcu->readers[i], 1);
+		if (atomic_load(&rcu->current) == i) {
+			return &rcu->slots[i];
+		}
+		atomic_fetch_sub(&rcu->readers[i], 1);
+	}
+}
+
+void acl_rcu_read_unlock(
+	struct acl_rcu *rcu, struct access_control_list *acl)
+{
+	atomic_fetch_sub(&rcu->readers[acl - rcu->slots], 1);
+}
+
+/*
+ * Return the spare snapshot for the writer to build the next version in,
+ * either as a copy of the published one (`copy`) or left as it is for a full
+ * rebuild with acl_load() or acl_snapshot_begin(). Returns NULL without
+ * waiting if readers of the previous snapshot haven't drained yet.
+ *
+ * Both slots save to the same file, so a rebuild still takes the journal
+ * state of the published one: saving under an epoch the file has already
+ * moved past would let acl_load() replay records twice.
+ */
+struct access_control_list *acl_rcu_begin_update(
+	struct acl_rcu *rcu, bool copy)
+{
+	int spare = 1 - atomic_load(&rcu->current);
+	if (atomic_load(&rcu->readers[spare]) != 0) {
+		return NULL;
+	}
+
+	struct access_control_list *next = &rcu->slots[spare];
+	const struct access_control_list *published = &rcu->slots[1 - spare];
+	if (copy) {
+		if (acl_copy(next, published) != 0) {
+			return NULL;
+		}
+	} else {
+		next->file_path = published->file_path;
+		next->journal_count = published->journal_count;
+		next->epoch = published->epoch;
+	}
+	return next;
+}
+
+/*
+ * Make `acl` (from acl_rcu_begin_update()) the snapshot new readers see.
+ */
+void acl_rcu_publish(struct acl_rcu *rcu, struct access_control_list *acl)
+{
+	atomic_store(&rcu->current, (int)(acl - rcu->slots));
+}
+
+/*
+ * Hand `op` over to the main loop. Safe to call from an interrupt while the
+ * main loop runs acl_rcu_apply_queued(), as long as only one context
+ * queues. Returns 0 on success, -1 if the queue is full.
+ */
+int acl_rcu_queue(struct acl_rcu *rcu, const struct acl_op *op)
+{
+	unsigned tail = atomic_load(&rcu->queue_tail);
+	if (tail - atomic_load(&rcu->queue_head) == ACL_RCU_QUEUE) {
+		return -1;
+	}
+	rcu->queued[tail % ACL_RCU_QUEUE] = *op;
+	atomic_store(&rcu->queue_tail, tail + 1);
+	return 0;
+}
+
+/*
+ * Hand one snapshot frame over to the main loop, like acl_rcu_queue().
+ * Returns 0 on success, -1 if the queue is full or the frame too long.
+ */
+int acl_rcu_queue_frame(
+	struct acl_rcu *rcu, const uint8_t *frame, size_t size)
+{
+	unsigned tail = atomic_load(&rcu->frame_tail);
+	if (size > ACL_WIRE_FRAME_MAX
+		|| tail - atomic_load(&rcu->frame_head) == ACL_RCU_FRAMES) {
+		return -1;
+	}
+	struct acl_rcu_frame *slot = &rcu->frames[tail % ACL_RCU_FRAMES];
+	memcpy(slot->bytes, frame, size);
+	slot->size = size;
+	atomic_store(&rcu->frame_tail, tail + 1);
+	return 0;
+}
+
+/*
+ * Decode the queued frames into the spare, and publish it once a snapshot
+ * is complete. A damaged snapshot is dropped; the spare is rebuilt when the
+ * server sends it again.
+ */
+static void acl_rcu_apply_frames(struct acl_rcu *rcu)
+{
+	unsigned head = atomic_load(&rcu->frame_head);
+	unsigned tail = atomic_load(&rcu->frame_tail);
+
+	for (; head != tail; head++) {
+		if (!rcu->syncing) {
+			rcu->syncing = acl_rcu_begin_update(rcu, false);
+			if (!rcu->syncing) {
+				break;
+			}
+			acl_wire_begin(&rcu->wire, rcu->syncing);
+		}
+
+		const struct acl_rcu_frame *frame =
+			&rcu->frames[head % ACL_RCU_FRAMES];
+		int status = acl_wire_feed(&rcu->wire, frame->bytes,
+			frame->size);
+		if (status > 0) {
+			acl_rcu_publish(rcu, rcu->syncing);
+		}
+		if (status != 0) {
+			rcu->syncing = NULL;
+		}
+	}
+	atomic_store(&rcu->frame_head, head);
+}
+
+/*
+ * Apply what was queued: snapshot frames first, then the ops, to a copy of
+ * the published snapshot that is published once they are in. Only the
+ * writer may call this. Ops stay queued while a full sync is under way,
+ * after which those it already holds are skipped, and while the spare
+ * can't be rebuilt yet. Returns the number of ops applied.
+ */
+int acl_rcu_apply_queued(struct acl_rcu *rcu)
+{
+	acl_rcu_apply_frames(rcu);
+	if (rcu->syncing) {
+		return 0;
+	}
+
+	unsigned head = atomic_load(&rcu->queue_head);
+	unsigned tail = atomic_load(&rcu->queue_tail);
+	if (head == tail) {
+		return 0;
+	}
+
+	struct access_control_list *next = acl_rcu_begin_update(rcu, true);
+	if (!next) {
+		return 0;
+	}
+
+	int applied = 0;
+	for (; head != tail; head++) {
+		const struct acl_op *op = &rcu->queued[head % ACL_RCU_QUEUE];
+		int status = acl_apply_op(next, op);
+		if (status > 0) {
+			applied++;
+		} else if (status < 0) {
+			fprintf(stderr,
+				"[ACL] Change %u doesn't follow generation "
+				"%u.\n",
+				op->generation, acl_generation(next));
+		}
+	}
+	atomic_store(&rcu->queue_head, head);
+	acl_rcu_publish(rcu, next);
+	return applied;
+}
@@ -0,0 +1,72 @@
+#ifndef ACL_RCU_H
+#define ACL_RCU_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "acl.h"
+#include "acl_wire.h"
+
+/*
+ * Double-buffered ACL snapshots for lock-free lookups.
+ *
+ * Readers take the published snapshot with acl_rcu_read_lock() and never
+ * wait. A published snapshot is never modified: the writer builds the next
+ * one in the spare slot and publishes it with a single atomic store. The
+ * spare can only be rebuilt once every reader of it has left, which
+ * acl_rcu_begin_update() checks without blocking.
+ *
+ * There must be only one writer at a time, and it is the main loop: a
+ * rebuild allocates and saves to the file system, neither of which may
+ * happen in the network callback, which runs in IRQ context on the Pico.
+ * The callback hands each op and snapshot frame over with acl_rcu_queue()
+ * and acl_rcu_queue_frame() instead, which only copy it into a ring, and
+ * the main loop applies what was queued with acl_rcu_apply_queued(). An op
+ * or frame dropped because its ring was full leaves a gap in the
+ * generations or frames, which the next sync fills.
+ */
+#ifndef ACL_RCU_QUEUE
+#define ACL_RCU_QUEUE 32
+#endif
+#ifndef ACL_RCU_FRAMES
+#define ACL_RCU_FRAMES 4
+#endif
+
+struct acl_rcu_frame {
+	size_t size;
+	uint8_t bytes[ACL_WIRE_FRAME_MAX];
+};
+
+struct acl_rcu {
+	struct access_control_list slots[2];
+	atomic_int current;
+	atomic_uint readers[2];
+	/* ops queued[head] to queued[tail - 1], indexes mod ACL_RCU_QUEUE */
+	struct acl_op queued[ACL_RCU_QUEUE];
+	atomic_uint queue_head;
+	atomic_uint queue_tail;
+	/* the same for snapshot frames */
+	struct acl_rcu_frame frames[ACL_RCU_FRAMES];
+	atomic_uint frame_head;
+	atomic_uint frame_tail;
+	/* the spare while a full sync is decoded into it, NULL otherwise */
+	struct access_control_list *syncing;
+	struct acl_wire_decoder wire;
+};
+
+int acl_rcu_init(struct acl_rcu *rcu, const char *file_path,
+	size_t ram_budget);
+void acl_rcu_free(struct acl_rcu *rcu);
+struct access_control_list *acl_rcu_read_lock(struct acl_rcu *rcu);
+void acl_rcu_read_unlock(
+	struct acl_rcu *rcu, struct access_control_list *acl);
+struct access_control_list *acl_rcu_begin_update(
+	struct acl_rcu *rcu, bool copy);
+void acl_rcu_publish(struct acl_rcu *rcu, struct access_control_list *acl);
+int acl_rcu_queue(struct acl_rcu *rcu, const struct acl_op *op);
+int acl_rcu_queue_frame(
+	struct acl_rcu *rcu, const uint8_t *frame, size_t size);
+int acl_rcu_apply_queued(struct acl_rcu *rcu);
+
+#endif // ACL_RCU_H
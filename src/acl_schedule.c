@@ -0,0 +1,77 @@
+#include <string.h>
+
+#include "acl_schedule.h"
+
+void acl_schedule_clear(struct acl_schedule *schedule)
+{
+	memset(schedule, 0, sizeof(*schedule));
+}
+
+/*
+ * Allow access on `weekday` from `start_minute` up to, but not including,
+ * `end_minute` (minutes past midnight, at most 24 * 60).
+ */
+void acl_schedule_allow(struct acl_schedule *schedule, unsigned weekday,
+	unsigned start_minute, unsigned end_minute)
+{
+	if (weekday >= 7 || end_minute > 24 * 60) {
+		return;
+	}
+
+	unsigned first = acl_schedule_slot(weekday, start_minute);
+	unsigned last = acl_schedule_slot(weekday, end_minute);
+	for (unsigned slot = first; slot < last; slot++) {
+		schedule->slots[slot / 8] |= (uint8_t)(1u << (slot % 8));
+	}
+}
+
+/*
+ * FNV-1a over the bitmap, finished like uid_hash(). Never 0, so it can't be
+ * mistaken for the seed of an unrestricted member.
+ */
+uint32_t acl_schedule_hash(const struct acl_schedule *schedule)
+{
+	uint32_t h = 2166136261u;
+
+	for (size_t i = 0; i < ACL_SCHEDULE_BYTES; i++) {
+		h = (h ^ schedule->slots[i]) * 16777619u;
+	}
+
+	h = uid_fmix32(h);
+	return h ? h : 1;
+}
+
+/*
+ * Parse a schedule as sent over MQTT: the bitmap bytes in order, two hex
+ * digits each. Returns 0 on success, -1 on malformed input.
+ */
+int acl_schedule_from_hex(struct acl_schedule *schedule, const char *hex)
+{
+	if (strlen(hex) != ACL_SCHEDULE_BYTES * 2) {
+		return -1;
+	}
+
+	for (size_t i = 0; i < ACL_SCHEDULE_BYTES; i++) {
+		int hi = uid_hex_value(hex[i * 2]);
+		int lo = uid_hex_value(hex[i * 2 + 1]);
+		if (hi < 0 || lo < 0) {
+			return -1;
+		}
+		schedule->slots[i] = (uint8_t)((hi << 4) | lo);
+	}
+	return 0;
+}
+
+/*
+ * `out` must hold ACL_SCHEDULE_HEX_LENGTH characters.
+ */
+void acl_schedule_to_hex(const struct acl_schedule *schedule, char *out)
+{
+	static const char digits[] = "0123456789abcdef";
+
+	for (size_t i = 0; i < ACL_SCHEDULE_BYTES; i++) {
+		out[i * 2] = digits[schedule->slots[i] >> 4];
+		out[i * 2 + 1] = digits[schedule->slots[i] & 0x0F];
+	}
+	out[ACL_SCHEDULE_BYTES * 2] = '\0';
+}
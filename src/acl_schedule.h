@@ -0,0 +1,61 @@
+#ifndef ACL_SCHEDULE_H
+#define ACL_SCHEDULE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sys/uid.h"
+
+/*
+ * Weekly access windows. A schedule is a bitmap with one bit per
+ * ACL_SCHEDULE_SLOT_MINUTES of the week, starting Monday 00:00 (slot s is
+ * bit s % 8 of byte s / 8), so checking it when a fob is presented is a
+ * single bit test.
+ *
+ * Members refer to a schedule by a small ID. ID 0 (ACL_SCHEDULE_ALWAYS) is
+ * unrestricted access and needs no bitmap; IDs 1 to ACL_MAX_SCHEDULES index
+ * the ACL's table, where identical bitmaps are stored once.
+ *
+ * A member's digest is seeded with acl_schedule_hash(schedule), so the ACL
+ * hash changes with the schedules. Unrestricted members keep the plain
+ * uid_hash(user, 0). tools/go_hasher has the reference implementation.
+ */
+#define ACL_SCHEDULE_SLOT_MINUTES 15
+#define ACL_SCHEDULE_SLOTS (7 * 24 * 60 / ACL_SCHEDULE_SLOT_MINUTES)
+#define ACL_SCHEDULE_BYTES (ACL_SCHEDULE_SLOTS / 8)
+/* two hex characters per byte plus the terminator */
+#define ACL_SCHEDULE_HEX_LENGTH (ACL_SCHEDULE_BYTES * 2 + 1)
+
+#define ACL_SCHEDULE_ALWAYS 0
+
+#ifndef ACL_MAX_SCHEDULES
+#define ACL_MAX_SCHEDULES 16
+#endif
+
+struct acl_schedule {
+	uint8_t slots[ACL_SCHEDULE_BYTES];
+};
+
+/*
+ * Slot of `minute` minutes past midnight on `weekday` (0 is Monday).
+ */
+static inline unsigned acl_schedule_slot(unsigned weekday, unsigned minute)
+{
+	return (weekday * 24 * 60 + minute) / ACL_SCHEDULE_SLOT_MINUTES;
+}
+
+static inline bool acl_schedule_allows(
+	const struct acl_schedule *schedule, unsigned slot)
+{
+	return (schedule->slots[slot / 8] >> (slot % 8)) & 1;
+}
+
+void acl_schedule_clear(struct acl_schedule *schedule);
+void acl_schedule_allow(struct acl_schedule *schedule, unsigned weekday,
+	unsigned start_minute, unsigned end_minute);
+uint32_t acl_schedule_hash(const struct acl_schedule *schedule);
+int acl_schedule_from_hex(struct acl_schedule *schedule, const char *hex);
+void acl_schedule_to_hex(const struct acl_schedule *schedule, char *out);
+
+#endif // ACL_SCHEDULE_H
@@ -0,0 +1,270 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "acl_wire.h"
+#include "crc32.h"
+
+/* version, flags and seq */
+#define ACL_WIRE_HEADER 4
+#define ACL_WIRE_CRC 4
+
+struct wire_reader {
+	const uint8_t *p;
+	const uint8_t *end;
+};
+
+static bool wire_u8(struct wire_reader *reader, uint8_t *value)
+{
+	if (reader->p == reader->end) {
+		return false;
+	}
+	*value = *reader->p++;
+	return true;
+}
+
+static bool wire_u32(struct wire_reader *reader, uint32_t *value)
+{
+	if (reader->end - reader->p < 4) {
+		return false;
+	}
+	const uint8_t *p = reader->p;
+	*value = p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16
+		| (uint32_t)p[3] << 24;
+	reader->p += 4;
+	return true;
+}
+
+static bool wire_varint(struct wire_reader *reader, uint64_t *value)
+{
+	*value = 0;
+	for (unsigned shift = 0; shift < 64; shift += 7) {
+		uint8_t byte;
+		if (!wire_u8(reader, &byte)) {
+			return false;
+		}
+		*value |= (uint64_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Read the next UID of a section: `key` is the previous one as a
+ * big-endian integer of `len` bytes.
+ */
+static bool wire_uid(struct wire_reader *reader, uint8_t len, uint64_t *key,
+	struct uid *uid)
+{
+	uint64_t delta;
+	if (!wire_varint(reader, &delta)) {
+		return false;
+	}
+	uint64_t next = *key + delta;
+	if (next < *key || (len < 8 && next >> (8 * len) != 0)) {
+		return false;
+	}
+	*key = next;
+
+	uint8_t bytes[8];
+	for (uint8_t i = 0; i < len; i++) {
+		bytes[i] = (uint8_t)(next >> (8 * (len - 1 - i)));
+	}
+	return uid_set(uid, bytes, len) == 0;
+}
+
+static const char *wire_users(
+	struct acl_wire_decoder *decoder, struct wire_reader *reader)
+{
+	uint8_t len;
+	uint64_t count;
+	if (!wire_u8(reader, &len) || len > 8
+		|| !wire_varint(reader, &count)) {
+		return "bad section";
+	}
+
+	uint64_t key = 0;
+	for (uint64_t i = 0; i < count; i++) {
+		struct uid uid;
+		if (!wire_uid(reader, len, &key, &uid)) {
+			return "bad uid";
+		}
+		if (uid_compare(&decoder->last, &uid) >= 0) {
+			return "users out of order";
+		}
+		if (acl_snapshot_user(decoder->acl, &uid) != 0) {
+			return "ACL arena is full";
+		}
+		decoder->last = uid;
+		decoder->users++;
+	}
+	return NULL;
+}
+
+static const char *wire_attrs(
+	struct acl_wire_decoder *decoder, struct wire_reader *reader)
+{
+	uint8_t len;
+	uint64_t count;
+	if (!wire_u8(reader, &len) || len > 8
+		|| !wire_varint(reader, &count)) {
+		return "bad section";
+	}
+
+	uint64_t key = 0;
+	for (uint64_t i = 0; i < count; i++) {
+		struct uid uid;
+		uint8_t schedule;
+		uint8_t doors;
+		if (!wire_uid(reader, len, &key, &uid)
+			|| !wire_u8(reader, &schedule)
+			|| !wire_u8(reader, &doors)) {
+			return "bad uid";
+		}
+		if (acl_snapshot_attrs(decoder->acl, &uid, schedule, doors)
+			!= 0) {
+			return "bad member";
+		}
+	}
+	return NULL;
+}
+
+static const char *wire_schedule(
+	struct acl_wire_decoder *decoder, struct wire_reader *reader)
+{
+	struct acl_schedule schedule;
+	if (reader->end - reader->p < ACL_SCHEDULE_BYTES) {
+		return "bad section";
+	}
+	memcpy(schedule.slots, reader->p, ACL_SCHEDULE_BYTES);
+	reader->p += ACL_SCHEDULE_BYTES;
+
+	if (acl_snapshot_schedule(decoder->acl, &schedule) != 0) {
+		return "too many schedules";
+	}
+	return NULL;
+}
+
+static const char *wire_frame(struct acl_wire_decoder *decoder,
+	const uint8_t *frame, size_t size, bool *last)
+{
+	if (size < ACL_WIRE_HEADER + ACL_WIRE_CRC) {
+		return "too short";
+	}
+
+	struct wire_reader reader = {frame, frame + size - ACL_WIRE_CRC};
+	struct wire_reader tail = {reader.end, frame + size};
+	uint32_t crc;
+	wire_u32(&tail, &crc);
+	if (crc32_update(0, frame, size - ACL_WIRE_CRC) != crc) {
+		return "CRC mismatch";
+	}
+
+	uint8_t version = frame[0];
+	uint8_t flags = frame[1];
+	uint16_t seq = (uint16_t)(frame[2] | frame[3] << 8);
+	bool first = flags & ACL_WIRE_FIRST;
+	reader.p += ACL_WIRE_HEADER;
+	if (version != ACL_WIRE_VERSION) {
+		return "unsupported version";
+	}
+	if (first) {
+		// a new snapshot replaces one that was cut short
+		acl_wire_begin(decoder, decoder->acl);
+	}
+	if (seq != decoder->seq || first != (seq == 0)) {
+		return "out of sequence";
+	}
+
+	if (first) {
+		uint64_t generation;
+		uint64_t user_count;
+		if (!wire_varint(&reader, &generation)
+			|| !wire_varint(&reader, &user_count)
+			|| !wire_u32(&reader, &decoder->hash)
+			|| generation > UINT32_MAX
+			|| user_count > UINT32_MAX) {
+			return "bad header";
+		}
+		decoder->generation = (uint32_t)generation;
+		decoder->user_count = (size_t)user_count;
+		acl_snapshot_begin(decoder->acl);
+	}
+
+	while (reader.p < reader.end) {
+		uint8_t tag;
+		wire_u8(&reader, &tag);
+
+		const char *error;
+		switch (tag) {
+		case ACL_WIRE_SCHEDULE:
+			error = wire_schedule(decoder, &reader);
+			break;
+		case ACL_WIRE_USERS:
+			error = wire_users(decoder, &reader);
+			break;
+		case ACL_WIRE_ATTRS:
+			error = wire_attrs(decoder, &reader);
+			break;
+		default:
+			error = "unknown section";
+			break;
+		}
+		if (error) {
+			return error;
+		}
+	}
+
+	*last = flags & ACL_WIRE_LAST;
+	if (*last && decoder->users != decoder->user_count) {
+		return "users missing";
+	}
+	if (*last && acl_hash(decoder->acl) != decoder->hash) {
+		return "hash mismatch";
+	}
+	return NULL;
+}
+
+/*
+ * Get ready to decode a snapshot into `acl`. The list is only emptied once
+ * the first frame arrives.
+ */
+void acl_wire_begin(
+	struct acl_wire_decoder *decoder, struct access_control_list *acl)
+{
+	memset(decoder, 0, sizeof(*decoder));
+	decoder->acl = acl;
+}
+
+/*
+ * Decode the next frame into the ACL. When the last frame checks out the
+ * list is saved at the snapshot's generation.
+ *
+ * Returns 1 once the snapshot is complete, 0 if more frames are needed and
+ * -1 if the frame is damaged or out of sequence. After an error the list
+ * holds part of a snapshot and must not be used; the decoder starts over at
+ * the next first frame.
+ */
+int acl_wire_feed(
+	struct acl_wire_decoder *decoder, const uint8_t *frame, size_t size)
+{
+	bool last = false;
+	const char *error = wire_frame(decoder, frame, size, &last);
+	if (error) {
+		fprintf(stderr, "[ACL] Snapshot frame %u: %s.\n",
+			(unsigned)decoder->seq, error);
+		acl_wire_begin(decoder, decoder->acl);
+		return -1;
+	}
+
+	decoder->seq++;
+	if (!last) {
+		return 0;
+	}
+
+	acl_set_generation(decoder->acl, decoder->generation);
+	acl_wire_begin(decoder, decoder->acl);
+	return 1;
+}
@@ -0,0 +1,67 @@
+#ifndef ACL_WIRE_H
+#define ACL_WIRE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "acl.h"
+#include "sys/uid.h"
+
+/*
+ * Compact snapshot of a whole ACL, for a full sync. The server splits it
+ * into frames of at most ACL_WIRE_FRAME_MAX bytes, small enough to fit in
+ * lwIP's buffers one at a time, and the device decodes each frame straight
+ * into the list as it arrives.
+ *
+ * Frame, multi-byte fields little-endian:
+ *
+ *   u8  version  ACL_WIRE_VERSION
+ *   u8  flags    ACL_WIRE_FIRST, ACL_WIRE_LAST
+ *   u16 seq      0 for the first frame, then counting up
+ *   first frame only:
+ *     varint generation, varint user_count, u32 acl_hash
+ *   sections until the CRC:
+ *     u8 ACL_WIRE_SCHEDULE, then ACL_SCHEDULE_BYTES of bitmap
+ *     u8 ACL_WIRE_USERS, u8 uid length, varint n, n * varint delta
+ *     u8 ACL_WIRE_ATTRS, u8 uid length, varint n,
+ *       n * (varint delta, u8 schedule, u8 door mask)
+ *   u32 crc      CRC-32 of everything before it
+ *
+ * Varints are unsigned LEB128. Within a section UIDs share one length and
+ * are sent in increasing order as the difference between consecutive UIDs
+ * read as big-endian integers, the first from 0. Sorted UIDs have long
+ * common prefixes, so the differences are short.
+ *
+ * Schedules come first and are numbered from 1 in the order sent, then the
+ * users, all in uid_compare() order, then the members with a schedule or
+ * door mask. tools/go_hasher has the encoder.
+ */
+#define ACL_WIRE_VERSION 1
+#define ACL_WIRE_FRAME_MAX 512
+
+#define ACL_WIRE_FIRST 0x01
+#define ACL_WIRE_LAST 0x02
+
+#define ACL_WIRE_SCHEDULE 1
+#define ACL_WIRE_USERS 2
+#define ACL_WIRE_ATTRS 3
+
+struct acl_wire_decoder {
+	struct access_control_list *acl;
+	/* from the first frame */
+	uint32_t generation;
+	uint32_t hash;
+	size_t user_count;
+	/* users decoded so far, and the last one, to check the order */
+	size_t users;
+	struct uid last;
+	/* the frame expected next */
+	uint16_t seq;
+};
+
+void acl_wire_begin(
+	struct acl_wire_decoder *decoder, struct access_control_list *acl);
+int acl_wire_feed(
+	struct acl_wire_decoder *decoder, const uint8_t *frame, size_t size);
+
+#endif // ACL_WIRE_H
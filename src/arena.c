@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGN 8
+
+static size_t align_up(size_t size)
+{
+	return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+/*
+ * Reserve `size` bytes for the arena.
+ * Returns 0 on success, -1 if the memory couldn't be reserved.
+ */
+int arena_init(struct arena *arena, size_t size)
+{
+	arena->used = 0;
+	arena->size = 0;
+	arena->base = malloc(size);
+	if (!arena->base) {
+		fprintf(stderr, "[arena] Failed to reserve %zu bytes.\n", size);
+		return -1;
+	}
+	arena->size = size;
+	return 0;
+}
+
+void arena_free(struct arena *arena)
+{
+	free(arena->base);
+	arena->base = NULL;
+	arena->size = 0;
+	arena->used = 0;
+}
+
+void arena_reset(struct arena *arena)
+{
+	arena->used = 0;
+}
+
+void *arena_alloc(struct arena *arena, size_t size)
+{
+	size = align_up(size);
+	if (!arena->base || size > arena->size - arena->used) {
+		return NULL;
+	}
+
+	void *ptr = arena->base + arena->used;
+	arena->used += size;
+	return ptr;
+}
+
+/*
+ * Grow the allocation at `ptr` from `old_size` to `new_size` bytes without
+ * moving it. Only the most recent allocation can be extended.
+ */
+bool arena_extend(
+	struct arena *arena, void *ptr, size_t old_size, size_t new_size)
+{
+	uint8_t *start = ptr;
+	old_size = align_up(old_size);
+	new_size = align_up(new_size);
+
+	if (start + old_size != arena->base + arena->used) {
+		return false;
+	}
+	if (new_size < old_size
+		|| new_size - old_size > arena->size - arena->used) {
+		return false;
+	}
+
+	arena->used += new_size - old_size;
+	return true;
+}
+
+/*
+ * Borrow the unused end of the arena as scratch space without allocating it.
+ * The memory is only valid until the next allocation.
+ */
+void *arena_tail(struct arena *arena, size_t size)
+{
+	if (!arena->base || align_up(size) > arena->size - arena->used) {
+		return NULL;
+	}
+	return arena->base + arena->used;
+}
@@ -0,0 +1,28 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A bump allocator over a single block reserved once at init. Allocations
+ * are never freed individually; arena_reset() releases all of them at once.
+ * The most recent allocation can be grown in place, which lets a single
+ * array grow in chunks while staying contiguous.
+ */
+struct arena {
+	uint8_t *base;
+	size_t size;
+	size_t used;
+};
+
+int arena_init(struct arena *arena, size_t size);
+void arena_free(struct arena *arena);
+void arena_reset(struct arena *arena);
+void *arena_alloc(struct arena *arena, size_t size);
+bool arena_extend(
+	struct arena *arena, void *ptr, size_t old_size, size_t new_size);
+void *arena_tail(struct arena *arena, size_t size);
+
+#endif // ARENA_H
@@ -4,48 +4,93 @@
 #include <string.h>
 
 #include "acl.h"
+#include "acl_rcu.h"
 #include "sys/rfid_reader.h"
 #include "sys/sys.h"
 
 struct rfid_reader reader;
-struct access_control_list acl;
+struct acl_rcu acl;
+struct acl_image acl_image;
 
 void init_acl()
 {
-	acl.file_path = "acl";
-	acl.user_count = 0;
+	if (acl_rcu_init(&acl, "acl", ACL_RAM_BUDGET) != 0) {
+		printf("failed to initialize acl\n");
+		return;
+	}
+
+	struct access_control_list *next = acl_rcu_begin_update(&acl, false);
+
+	acl_append_hex(next, "fa4efb01");
+	acl_append_hex(next, "fa4efb02");
+	acl_append_hex(next, "fa4efb03");
+	acl_append_hex(next, "dbe8893f85");
+
+	if (acl_image_map(&acl_image, "acl.img") == 0) {
+		acl_attach_image(next, &acl_image);
+	}
 
-	acl_append_user(&acl, "fakefob1");
-	acl_append_user(&acl, "fakefob2");
-	acl_append_user(&acl, "fakefob3");
-	acl_append_user(&acl, "dbe8893f85");
+	acl_rcu_publish(&acl, next);
 }
 
 void load_acl()
 {
 	struct access_control_list loaded_acl;
+	if (acl_init(&loaded_acl, "acl", ACL_RAM_BUDGET) != 0) {
+		return;
+	}
 	acl_load(&loaded_acl, "acl");
 
 	/*acl_print(&loaded_acl);*/
 	uint32_t hash = acl_hash(&loaded_acl);
 	printf("ACL Hash: %u\n", hash);
+
+	acl_free(&loaded_acl);
 }
 
 #ifdef __PICO_BUILD__
 #include "pico/stdlib.h"
 #include "sys/device/relay.h"
 
-void test_uid(struct access_control_list *acl, char *uid)
+/*
+ * Until the clock is known only members without a schedule get in.
+ */
+static bool access_allowed(
+	struct access_control_list *acl, const struct uid *uid)
+{
+	unsigned weekday;
+	unsigned minute;
+	if (sys_local_time(&weekday, &minute) != 0) {
+		return acl_has_user(acl, uid)
+			&& acl_user_schedule(acl, uid) == ACL_SCHEDULE_ALWAYS;
+	}
+	return acl_user_allowed(
+		acl, uid, acl_schedule_slot(weekday, minute));
+}
+
+/* the door stays open this long after a granted read */
+#define RELAY_OPEN_MS 3000
+
+static bool relay_open;
+static absolute_time_t relay_close_at;
+
+void test_uid(struct acl_rcu *rcu, const struct uid *uid)
 {
-	if (acl_has_user(acl, uid)) {
-		printf("user %s exists\n", uid);
+	char hex[UID_HEX_LENGTH];
+	uid_to_hex(uid, hex);
+
+	struct access_control_list *acl = acl_rcu_read_lock(rcu);
+	bool granted = access_allowed(acl, uid);
+	acl_rcu_read_unlock(rcu, acl);
+
+	if (granted) {
+		printf("user %s exists\n", hex);
 
-		// can we open the relay without stopping the universe?
 		relay_enable();
-		sleep_ms(3000);
-		relay_disable();
+		relay_open = true;
+		relay_close_at = make_timeout_time_ms(RELAY_OPEN_MS);
 	} else {
-		printf("user %s doesn't exist\n", uid);
+		printf("user %s doesn't exist\n", hex);
 	}
 }
 void init()
@@ -55,21 +100,28 @@ void init()
 	rfid_reader_init(&reader);
 }
 
-void update_reader()
+void print_status()
 {
-	uint32_t hash = acl_hash(&acl);
+	struct access_control_list *current = acl_rcu_read_lock(&acl);
+	uint32_t hash = acl_hash(current);
+	acl_rcu_read_unlock(&acl, current);
+
 	printf("ACL Hash: %u\n", hash);
-	if (rfid_reader_wait_for_card(&reader, 500) == 0) {
-		printf("Card detected. Reading UID...\n");
-
-		char uid[11];
-		if (rfid_reader_read(&reader, uid) == 0) {
-			test_uid(&acl, uid);
-		} else {
-			printf("Failed to read card.\n");
-		}
-	} else {
-		/*printf("No card detected.\n");*/
+}
+
+void update_reader()
+{
+	if (relay_open && time_reached(relay_close_at)) {
+		relay_disable();
+		relay_open = false;
+	}
+
+	struct uid uid;
+	int read = rfid_reader_poll(&reader, &uid);
+	if (read > 0) {
+		test_uid(&acl, &uid);
+	} else if (read < 0) {
+		printf("Failed to read card.\n");
 	}
 }
 #else
@@ -77,15 +129,22 @@ void init()
 {
 	init_acl();
 }
-void update_reader()
+void print_status()
 {
-	acl_print(&acl);
-	uint32_t hash = acl_hash(&acl);
+	struct access_control_list *current = acl_rcu_read_lock(&acl);
+	acl_print(current);
+	uint32_t hash = acl_hash(current);
+	acl_rcu_read_unlock(&acl, current);
+
 	printf("ACL Hash: %u\n", hash);
 }
+void update_reader()
+{
+}
 #endif
 
 int counter = 0;
+int ticks = 0;
 
 /*
  * we need to be able to check if systems are running.
@@ -97,17 +156,24 @@ int counter = 0;
  */
 void update()
 {
-	counter++;
+	// about once a second
+	if (++ticks >= 1000 / SYS_TICK_MS) {
+		ticks = 0;
+		counter++;
 
-	if (counter > 100) {
-		counter = 0;
+		if (counter > 100) {
+			counter = 0;
+		}
+		printf("counter: %d\n", counter);
+		print_status();
 	}
-	printf("counter: %d\n", counter);
 
 	// connect to wifi
 	// initialize event manager
 	//
 	// loop on an interval
+	// apply the ACL changes the network callback queued
+	acl_rcu_apply_queued(&acl);
 	// we should check if a card is being read
 	update_reader();
 	//
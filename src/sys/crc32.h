@@ -0,0 +1,13 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * CRC-32 (IEEE 802.3, as used by zlib and Go's hash/crc32).
+ * Start with crc32_update(0, ...) and feed the result back in to continue.
+ */
+uint32_t crc32_update(uint32_t crc, const void *data, size_t len);
+
+#endif // CRC32_H
@@ -4,6 +4,15 @@
 #include <stdio.h>
 #include <string.h>
 
+/*
+ * Receive timeouts in ticks of the chip's timer, 0.5 ms each. A card
+ * answers REQA, anticollision and select within 100 us (and acknowledges
+ * HLTA by staying quiet for 1 ms), so finding cards doesn't need to wait
+ * out the timeout the MIFARE memory commands get.
+ */
+#define MFRC522_TIMER_DEFAULT 30
+#define MFRC522_TIMER_SHORT 2
+
 static inline void cs_select(MFRC522_t *dev)
 {
 	gpio_put(dev->cs_pin, 0);
@@ -25,6 +34,12 @@ static void MFRC522_write_register(MFRC522_t *dev, uint8_t reg, uint8_t val)
 	uint8_t addr_byte = ((reg << 1) & 0x7E);
 	uint8_t outBuf[2] = {addr_byte, val};
 
+	if (reg == BitFramingReg) {
+		dev->bit_framing = val & 0x7F;
+	} else if (reg == TReloadRegL) {
+		dev->timer_reload = val;
+	}
+
 	cs_select(dev);
 	spi_write_blocking(dev->spi_port, outBuf, 2);
 	cs_deselect(dev);
@@ -50,6 +65,87 @@ static uint8_t MFRC522_read_register(MFRC522_t *dev, uint8_t reg)
 	return inBuf[1];
 }
 
+/**
+ * Write `len` bytes to the FIFO in one transaction. The address byte is
+ * sent once and every data byte after it goes to the same register.
+ */
+static void MFRC522_write_fifo(
+	MFRC522_t *dev, const uint8_t *data, size_t len)
+{
+	uint8_t addr_byte = ((FIFODataReg << 1) & 0x7E);
+
+	cs_select(dev);
+	spi_write_blocking(dev->spi_port, &addr_byte, 1);
+	spi_write_blocking(dev->spi_port, data, len);
+	cs_deselect(dev);
+}
+
+/**
+ * Read `n` registers in one transaction. The chip answers each address
+ * byte with the content of the register addressed by the byte before it,
+ * so the list may repeat a register (the FIFO) or name different ones.
+ */
+static void MFRC522_read_registers(
+	MFRC522_t *dev, const uint8_t *regs, uint8_t *out, size_t n)
+{
+	uint8_t outBuf[MFRC522_FIFO_SIZE + 1];
+	uint8_t inBuf[MFRC522_FIFO_SIZE + 1];
+
+	for (size_t i = 0; i < n; i++) {
+		outBuf[i] = ((regs[i] << 1) & 0x7E) | 0x80;
+	}
+	outBuf[n] = 0x00;
+
+	cs_select(dev);
+	spi_write_read_blocking(dev->spi_port, outBuf, inBuf, n + 1);
+	cs_deselect(dev);
+
+	memcpy(out, &inBuf[1], n);
+}
+
+/**
+ * Read `len` bytes from the FIFO in one transaction.
+ */
+static void MFRC522_read_fifo(MFRC522_t *dev, uint8_t *data, size_t len)
+{
+	uint8_t regs[MFRC522_FIFO_SIZE];
+	memset(regs, FIFODataReg, len);
+	MFRC522_read_registers(dev, regs, data, len);
+}
+
+/**
+ * Write a list of {register, value} pairs. Writes can't share a
+ * transaction between registers, but one table keeps init sequences in one
+ * place.
+ */
+static void MFRC522_write_sequence(
+	MFRC522_t *dev, const uint8_t (*seq)[2], size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		MFRC522_write_register(dev, seq[i][0], seq[i][1]);
+	}
+}
+
+/**
+ * Set the receive timeout, skipping the write if it is already set.
+ */
+static void MFRC522_set_timer(MFRC522_t *dev, uint8_t ticks)
+{
+	if (dev->timer_reload != ticks) {
+		MFRC522_write_register(dev, TReloadRegL, ticks);
+	}
+}
+
+/**
+ * Set TxLastBits/RxAlign, skipping the write if they are already set.
+ */
+static void MFRC522_set_bit_framing(MFRC522_t *dev, uint8_t val)
+{
+	if (dev->bit_framing != val) {
+		MFRC522_write_register(dev, BitFramingReg, val);
+	}
+}
+
 /**
  * Set specific bits (mask) in a register.
  */
@@ -68,33 +164,66 @@ static void MFRC522_clear_bits(MFRC522_t *dev, uint8_t reg, uint8_t mask)
 	MFRC522_write_register(dev, reg, tmp & (~mask));
 }
 
+/**
+ * Wait for one of the `done` bits in `reg` (CommIrqReg or DivIrqReg).
+ *
+ * With the IRQ pin wired the core sleeps until MFRC522_irq_notify() is
+ * called and the register is read once, then the bits are cleared so the
+ * pin is released for the next command. Otherwise the register is polled.
+ * Returns the register's value, or -1 if none of the bits came up in time.
+ */
+static int MFRC522_wait(MFRC522_t *dev, uint8_t reg, uint8_t done)
+{
+	absolute_time_t deadline = make_timeout_time_ms(MFRC522_TIMEOUT_MS);
+	uint8_t n;
+
+	if (dev->use_irq) {
+		while (!dev->irq_pending
+			&& !best_effort_wfe_or_timeout(deadline)) {
+		}
+		n = MFRC522_read_register(dev, reg);
+		// With Set1/Set2 (bit 7) clear, every bit written as 1 is
+		// cleared
+		MFRC522_write_register(dev, reg, done);
+
+		if (!dev->irq_pending && (n & done)) {
+			// the chip finished but the pin never fired
+			printf("[WARN] MFRC522: no IRQ, polling instead.\n");
+			MFRC522_use_irq(dev, false);
+		}
+		return (n & done) ? n : -1;
+	}
+
+	do {
+		n = MFRC522_read_register(dev, reg);
+		if (n & done) {
+			return n;
+		}
+	} while (!time_reached(deadline));
+	return -1;
+}
+
 /**
  * Calculate CRC of a data buffer.
  */
 static void MFRC522_calculate_crc(
 	MFRC522_t *dev, const uint8_t *data, size_t length, uint8_t *result)
 {
-	MFRC522_clear_bits(dev, DivIrqReg, 0x04);  // Clear the CRC interrupt
-	MFRC522_set_bits(dev, FIFOLevelReg, 0x80); // Clear FIFO pointer
+	MFRC522_write_register(dev, DivIrqReg, 0x04); // Clear CRCIRq
+	dev->irq_pending = false;
+	// Clear FIFO pointer; the other bits of FIFOLevelReg are read-only
+	MFRC522_write_register(dev, FIFOLevelReg, 0x80);
 
-	// Write data to FIFO
-	for (size_t i = 0; i < length; i++) {
-		MFRC522_write_register(dev, FIFODataReg, data[i]);
-	}
+	MFRC522_write_fifo(dev, data, length);
 	// Start CRC calculation
 	MFRC522_write_register(dev, CommandReg, PCD_CALCCRC);
 
-	// Poll for CRC completion
-	uint16_t i = 0xFF;
-	uint8_t n;
-	do {
-		n = MFRC522_read_register(dev, DivIrqReg);
-		i--;
-	} while ((i != 0) && !(n & 0x04)); // bit 2: CRCIRq
+	// bit 2: CRCIRq
+	MFRC522_wait(dev, DivIrqReg, 0x04);
 
 	// Read the result
-	result[0] = MFRC522_read_register(dev, CRCResultRegL);
-	result[1] = MFRC522_read_register(dev, CRCResultRegH);
+	static const uint8_t regs[2] = {CRCResultRegL, CRCResultRegH};
+	MFRC522_read_registers(dev, regs, result, 2);
 }
 
 /**
@@ -147,8 +276,7 @@ static uint8_t MFRC522_to_card(MFRC522_t *dev, uint8_t cmd,
 	uint8_t status = MFRC522_ERR;
 	uint8_t irqEn = 0;
 	uint8_t waitIRq = 0;
-	uint8_t n, lastBits;
-	size_t i;
+	uint8_t lastBits;
 
 	if (cmd == PCD_AUTHENT) {
 		irqEn = 0x12;	// IRQ for Auth
@@ -158,46 +286,52 @@ static uint8_t MFRC522_to_card(MFRC522_t *dev, uint8_t cmd,
 		waitIRq = 0x30; // RxIRq and IdleIRq
 	}
 
-	MFRC522_write_register(
-		dev, CommIEnReg, irqEn | 0x80);	   // enable interrupts
-	MFRC522_clear_bits(dev, CommIrqReg, 0x80); // clear IRQ bits
-	MFRC522_set_bits(dev, FIFOLevelReg, 0x80); // flush FIFO
+	// The command ends on one of these or on the timer (bit 0)
+	uint8_t done = waitIRq | 0x01;
+
+	// Only the bits that end the wait drive the IRQ pin, active low
+	// (IRqInv); TxIRq and LoAlertIRq would raise it mid-command
+	MFRC522_write_register(dev, CommIEnReg, done | 0x80);
+	// With Set1 (bit 7) clear, every bit written as 1 is cleared
+	MFRC522_write_register(dev, CommIrqReg, 0x7F); // clear IRQ bits
+	dev->irq_pending = false;
+	MFRC522_write_register(dev, FIFOLevelReg, 0x80); // flush FIFO
 
 	// Idle
 	MFRC522_write_register(dev, CommandReg, PCD_IDLE);
 
-	// Write to FIFO
-	for (i = 0; i < sendLen; i++) {
-		MFRC522_write_register(dev, FIFODataReg, sendData[i]);
-	}
+	MFRC522_write_fifo(dev, sendData, sendLen);
 
 	// Execute command
 	MFRC522_write_register(dev, CommandReg, cmd);
 	if (cmd == PCD_TRANSCEIVE) {
 		// StartSend = set BitFramingReg bit7
-		MFRC522_set_bits(dev, BitFramingReg, 0x80);
+		MFRC522_write_register(
+			dev, BitFramingReg, dev->bit_framing | 0x80);
 	}
 
 	// Wait for the command to complete (or timeout)
-	uint16_t loopCount = 2000; // Rough wait
-	do {
-		n = MFRC522_read_register(dev, CommIrqReg);
-		loopCount--;
-	} while (loopCount && !(n & 0x01) && !(n & waitIRq));
+	int n = MFRC522_wait(dev, CommIrqReg, done);
 
 	// Stop sending in case of Transceive
-	MFRC522_clear_bits(dev, BitFramingReg, 0x80);
+	MFRC522_write_register(dev, BitFramingReg, dev->bit_framing);
 
-	if (loopCount == 0) {
+	if (n < 0) {
 		// We timed out waiting
 		printf("[ERR] MFRC522_to_card() timed out.\n");
-		return MFRC522_ERR;
+		return MFRC522_TIMEOUTERR;
 	}
 
-	// Check for errors
-	uint8_t errorVal = MFRC522_read_register(dev, ErrorReg);
-	if (!(errorVal & 0x1B)) {
-		status = MFRC522_OK;
+	// Check for errors, and how much came back, in one transaction
+	static const uint8_t resultRegs[3] = {
+		ErrorReg, FIFOLevelReg, ControlReg};
+	uint8_t result[3];
+	MFRC522_read_registers(dev, resultRegs, result, 3);
+
+	uint8_t errorVal = result[0];
+	if (!(errorVal & 0x13)) {
+		// on a collision the bits up to it are still good
+		status = (errorVal & 0x08) ? MFRC522_COLLERR : MFRC522_OK;
 		if (n & irqEn & 0x01) {
 			status = MFRC522_NOTAGERR;
 			/*printf("[WARN] No tag error (interrupt says no
@@ -205,10 +339,8 @@ static uint8_t MFRC522_to_card(MFRC522_t *dev, uint8_t cmd,
 		}
 		if (cmd == PCD_TRANSCEIVE) {
 			// Number of bytes in FIFO
-			uint8_t fifoLevel =
-				MFRC522_read_register(dev, FIFOLevelReg);
-			lastBits =
-				MFRC522_read_register(dev, ControlReg) & 0x07;
+			uint8_t fifoLevel = result[1] & 0x7F;
+			lastBits = result[2] & 0x07;
 			if (validBits) {
 				if (lastBits) {
 					*validBits =
@@ -223,10 +355,8 @@ static uint8_t MFRC522_to_card(MFRC522_t *dev, uint8_t cmd,
 				// hold, limit it
 				fifoLevel = *backLen;
 			}
-			// Read the FIFO
-			for (i = 0; i < fifoLevel; i++) {
-				backData[i] =
-					MFRC522_read_register(dev, FIFODataReg);
+			if (fifoLevel) {
+				MFRC522_read_fifo(dev, backData, fifoLevel);
 			}
 			*backLen = fifoLevel;
 		}
@@ -252,6 +382,10 @@ void MFRC522_init(MFRC522_t *dev, spi_inst_t *spi_port, uint cs_pin,
 	dev->cs_pin = cs_pin;
 	dev->rst_pin = rst_pin;
 	dev->baudrate = baudrate;
+	dev->bit_framing = 0;
+	dev->timer_reload = 0;
+	dev->use_irq = false;
+	dev->irq_pending = false;
 
 	// Initialize chosen SPI port at given baud rate
 	spi_init(dev->spi_port, dev->baudrate);
@@ -288,17 +422,26 @@ void MFRC522_wake(MFRC522_t *dev)
 	// Some default configuration (like the python init)
 	MFRC522_reset(dev);
 
-	// Timer: TPrescalerReg – prescaler value for the internal timer
-	// TModeReg: TAuto=1; f(Timer) = 6.78MHz/TPreScaler
-	MFRC522_write_register(dev, TModeReg, 0x8D);
-	MFRC522_write_register(dev, TPrescalerReg, 0x3E);
-	// Timer reload
-	MFRC522_write_register(dev, TReloadRegL, 30);
-	MFRC522_write_register(dev, TReloadRegH, 0);
-
-	// 100%ASK
-	MFRC522_write_register(dev, TxASKReg, 0x40);
-	MFRC522_write_register(dev, ModeReg, 0x3D); // CRC initial value 0x6363
+	static const uint8_t wake_sequence[][2] = {
+		// Timer: TPrescalerReg – prescaler value for the internal
+		// timer. TModeReg: TAuto=1; f(Timer) = 6.78MHz/TPreScaler
+		{TModeReg, 0x8D},
+		{TPrescalerReg, 0x3E},
+		// Timer reload
+		{TReloadRegL, MFRC522_TIMER_DEFAULT},
+		{TReloadRegH, 0},
+		// 100%ASK
+		{TxASKReg, 0x40},
+		{ModeReg, 0x3D}, // CRC initial value 0x6363
+		// zero the bits received after a collision
+		{CollReg, 0x00},
+	};
+	MFRC522_write_sequence(dev, wake_sequence,
+		sizeof(wake_sequence) / sizeof(wake_sequence[0]));
+	// the reset put the IRQ pin back to open drain
+	if (dev->use_irq) {
+		MFRC522_use_irq(dev, true);
+	}
 
 	// Turn on the antenna
 	MFRC522_antenna_on(dev, true);
@@ -310,6 +453,9 @@ void MFRC522_wake(MFRC522_t *dev)
 void MFRC522_reset(MFRC522_t *dev)
 {
 	MFRC522_write_register(dev, CommandReg, PCD_RESETPHASE);
+	// reset values
+	dev->bit_framing = 0;
+	dev->timer_reload = 0;
 }
 
 /**
@@ -327,13 +473,36 @@ void MFRC522_antenna_on(MFRC522_t *dev, bool on)
 	}
 }
 
+/**
+ * Wait for commands on the IRQ pin instead of polling the chip. The pin
+ * must be wired to a GPIO interrupt (falling edge) that calls
+ * MFRC522_irq_notify(). If the pin stays quiet while a command completes
+ * the driver goes back to polling.
+ */
+void MFRC522_use_irq(MFRC522_t *dev, bool on)
+{
+	// IRQPushPull drives the pin both ways, CRCIEn raises it for CalcCRC
+	MFRC522_write_register(dev, DivIEnReg, on ? 0x84 : 0x00);
+	dev->use_irq = on;
+}
+
+/**
+ * The IRQ pin fired. Safe to call from an interrupt handler, and what a
+ * simulated chip calls when it raises its IRQ line.
+ */
+void MFRC522_irq_notify(MFRC522_t *dev)
+{
+	dev->irq_pending = true;
+}
+
 /**
  * Request a tag (REQA or REQIDL).
  */
 uint8_t MFRC522_request(MFRC522_t *dev, uint8_t mode, uint8_t *outBits)
 {
 	// Setup bit framing
-	MFRC522_write_register(dev, BitFramingReg, 0x07);
+	MFRC522_set_bit_framing(dev, 0x07);
+	MFRC522_set_timer(dev, MFRC522_TIMER_SHORT);
 
 	uint8_t backData[16];
 	size_t backLen = sizeof(backData);
@@ -342,7 +511,11 @@ uint8_t MFRC522_request(MFRC522_t *dev, uint8_t mode, uint8_t *outBits)
 	uint8_t cmdBuffer[1] = {mode};
 	uint8_t status = MFRC522_to_card(dev, PCD_TRANSCEIVE, cmdBuffer, 1,
 		backData, &backLen, &validBits);
-	if ((status != MFRC522_OK) || (validBits != 0x10)) {
+	if (status == MFRC522_COLLERR) {
+		// several cards answered with different ATQAs
+		status = MFRC522_OK;
+	}
+	if ((status == MFRC522_OK) && (validBits != 0x10)) {
 		/*printf("[ERR] MFRC522_request() failed. validBits=0x%02X\n",
 		 * validBits);*/
 		status = MFRC522_ERR;
@@ -354,85 +527,123 @@ uint8_t MFRC522_request(MFRC522_t *dev, uint8_t mode, uint8_t *outBits)
 }
 
 /**
- * Anti-collision for a given anticollision command (0x93, 0x95, 0x97).
- * `serialOut` must have space for 5 bytes if successful.
+ * Anti-collision for a given cascade level (0x93, 0x95, 0x97).
+ * `serialOut` must have space for 5 bytes if successful: 4 UID bytes (or
+ * the cascade tag and 3 UID bytes) and the BCC.
+ *
+ * When several cards answer, the collision is resolved bit by bit: the
+ * cards with a 1 at the first colliding bit stay in, the others drop out
+ * until the next REQA. That takes one more frame per collision.
  */
 uint8_t MFRC522_anticoll(
 	MFRC522_t *dev, uint8_t antiCollVal, uint8_t *serialOut)
 {
+	// SEL, NVB, then the UID bytes and BCC as far as they are known
+	uint8_t frame[7] = {antiCollVal};
+	uint8_t known = 0; // bits
 	uint8_t serChk = 0;
-	uint8_t cmdBuffer[2] = {antiCollVal, 0x20};
 
-	// Clear the BitFramingReg
-	MFRC522_write_register(dev, BitFramingReg, 0x00);
-
-	// The response should be 5 bytes: 4 uid bytes + 1 BCC
-	uint8_t backData[10] = {0};
-	size_t backLen = sizeof(backData);
-	uint8_t validBits = 0;
-
-	uint8_t status = MFRC522_to_card(dev, PCD_TRANSCEIVE, cmdBuffer, 2,
-		backData, &backLen, &validBits);
+	MFRC522_set_timer(dev, MFRC522_TIMER_SHORT);
+
+	while (true) {
+		uint8_t count = known / 8;
+		uint8_t lastBits = known % 8;
+		size_t sendLen = 2 + count + (lastBits ? 1 : 0);
+
+		// NVB: whole bytes sent, counting SEL and NVB, and extra bits
+		frame[1] = (uint8_t)((2 + count) << 4 | lastBits);
+		// the answer starts at the first bit we didn't send
+		MFRC522_set_bit_framing(
+			dev, (uint8_t)(lastBits << 4 | lastBits));
+
+		uint8_t backData[5];
+		size_t backLen = sizeof(backData);
+		uint8_t status = MFRC522_to_card(dev, PCD_TRANSCEIVE, frame,
+			sendLen, backData, &backLen, NULL);
+		if (status != MFRC522_OK && status != MFRC522_COLLERR) {
+			return status;
+		}
+		if (backLen == 0 || 2 + count + backLen > sizeof(frame)) {
+			printf("[ERR] anticoll: Got %zu bytes after %u bits\n",
+				backLen, known);
+			return MFRC522_ERR;
+		}
 
-	if (status == MFRC522_OK) {
-		if (backLen == 5) {
-			// XOR check
-			for (int i = 0; i < 4; i++) {
-				serChk ^= backData[i];
+		// the first byte back shares its low bits with the sent ones
+		uint8_t mask = (uint8_t)(0xFF << lastBits);
+		frame[2 + count] =
+			(frame[2 + count] & ~mask) | (backData[0] & mask);
+		memcpy(&frame[3 + count], &backData[1], backLen - 1);
+
+		if (status == MFRC522_OK) {
+			if (2 + count + backLen != sizeof(frame)) {
+				printf("[ERR] anticoll: Expected 5 bytes, got "
+				       "%zu\n",
+					count + backLen);
+				return MFRC522_ERR;
 			}
-			if (serChk != backData[4]) {
-				printf("[ERR] anticoll: XOR check failed. "
-				       "(serChk=0x%02X, BCC=0x%02X)\n",
-					serChk, backData[4]);
-				status = MFRC522_ERR;
-			} else {
-				// Copy out the full 5 bytes
-				memcpy(serialOut, backData, 5);
-			}
-		} else {
-			printf("[ERR] anticoll: Expected 5 bytes, got %zu\n",
-				backLen);
-			status = MFRC522_ERR;
+			break;
+		}
+
+		// CollPos counts from the first bit of the first byte back,
+		// and 0 is the 32nd bit
+		uint8_t coll = MFRC522_read_register(dev, CollReg);
+		if (coll & 0x20) { // CollPosNotValid
+			return MFRC522_ERR;
+		}
+		uint8_t pos = count * 8 + ((coll & 0x1F) ? (coll & 0x1F) : 32);
+		if (pos <= known || pos > 32) {
+			return MFRC522_ERR;
 		}
+		frame[2 + (pos - 1) / 8] |= (uint8_t)(1 << ((pos - 1) % 8));
+		known = pos;
 	}
-	return status;
+
+	// XOR check
+	for (int i = 0; i < 4; i++) {
+		serChk ^= frame[2 + i];
+	}
+	if (serChk != frame[6]) {
+		printf("[ERR] anticoll: XOR check failed. "
+		       "(serChk=0x%02X, BCC=0x%02X)\n",
+			serChk, frame[6]);
+		return MFRC522_ERR;
+	}
+	// Copy out the full 5 bytes
+	memcpy(serialOut, &frame[2], 5);
+	return MFRC522_OK;
 }
 
 /**
  * MFRC522_select_tag
- * Uses the 'Select' command to finalize the UID selection on the MFRC522
+ * Select the card at cascade level `antiCollVal` with the 5 bytes
+ * MFRC522_anticoll returned. `sak` gets its SAK; PICC_SAK_CASCADE means
+ * the UID continues on the next level.
  */
-uint8_t MFRC522_select_tag(MFRC522_t *dev, const uint8_t *uid, uint8_t uid_size)
-{
-	// uid_size typically 5 for classic tags (4 + BCC)
-	// Construct command buffer [ anticoll cmd(0x93/95/97), 0x70, uid, CRC16
-	// ]
-	uint8_t cmdBuffer[10];
-	cmdBuffer[0] = PICC_ANTICOLL1; // Typically 0x93 if we are selecting
-				       // from anticoll1
+uint8_t MFRC522_select_tag(MFRC522_t *dev, uint8_t antiCollVal,
+	const uint8_t *serial, uint8_t *sak)
+{
+	// [ SEL, 0x70, 4 uid bytes, BCC, CRC16 ]
+	uint8_t cmdBuffer[9];
+	cmdBuffer[0] = antiCollVal;
 	cmdBuffer[1] = 0x70;
-
-	// Copy in the UID (4 or 5 bytes?), ignoring the final BCC if present
-	uint8_t copyLen = (uid_size > 5) ? 5 : uid_size;
-	for (int i = 0; i < copyLen; i++) {
-		cmdBuffer[2 + i] = uid[i];
-	}
-	size_t dataLen = 2 + copyLen;
+	memcpy(&cmdBuffer[2], serial, 5);
 
 	// Append CRC
-	uint8_t crcResult[2];
-	MFRC522_calculate_crc(dev, cmdBuffer, dataLen, crcResult);
-	cmdBuffer[dataLen++] = crcResult[0];
-	cmdBuffer[dataLen++] = crcResult[1];
+	MFRC522_calculate_crc(dev, cmdBuffer, 7, &cmdBuffer[7]);
+
+	MFRC522_set_bit_framing(dev, 0x00);
+	MFRC522_set_timer(dev, MFRC522_TIMER_SHORT);
 
-	// Prepare response
+	// Prepare response: SAK and its CRC
 	uint8_t backData[3];
 	size_t backLen = sizeof(backData);
 	uint8_t validBits = 0;
 
 	uint8_t status = MFRC522_to_card(dev, PCD_TRANSCEIVE, cmdBuffer,
-		dataLen, backData, &backLen, &validBits);
+		sizeof(cmdBuffer), backData, &backLen, &validBits);
 	if ((status == MFRC522_OK) && (backLen == 3) && (validBits == 0x18)) {
+		*sak = backData[0];
 		return MFRC522_OK;
 	}
 	printf("[ERR] select_tag: Could not select UID. status=%d, "
@@ -441,6 +652,26 @@ uint8_t MFRC522_select_tag(MFRC522_t *dev, const uint8_t *uid, uint8_t uid_size)
 		status, backLen, validBits);
 	return MFRC522_ERR;
 }
+
+/**
+ * Put the selected card to sleep (HLTA). It won't answer REQIDL again
+ * until it leaves the field and comes back.
+ */
+void MFRC522_halt(MFRC522_t *dev)
+{
+	uint8_t cmdBuffer[4] = {PICC_HALT, 0x00};
+	MFRC522_calculate_crc(dev, cmdBuffer, 2, &cmdBuffer[2]);
+
+	MFRC522_set_bit_framing(dev, 0x00);
+	MFRC522_set_timer(dev, MFRC522_TIMER_SHORT);
+
+	// the card acknowledges by not answering
+	uint8_t backData[2];
+	size_t backLen = sizeof(backData);
+	MFRC522_to_card(dev, PCD_TRANSCEIVE, cmdBuffer, sizeof(cmdBuffer),
+		backData, &backLen, NULL);
+}
+
 /**
  * Auth with a specific block address, key A or B
  */
@@ -460,6 +691,9 @@ uint8_t MFRC522_auth(MFRC522_t *dev, uint8_t authMode, uint8_t blockAddr,
 		packet[8 + i] = uid[i];
 	}
 
+	MFRC522_set_bit_framing(dev, 0x00);
+	MFRC522_set_timer(dev, MFRC522_TIMER_DEFAULT);
+
 	// Perform the command
 	uint8_t backData[4];
 	size_t backLen = sizeof(backData);
@@ -489,6 +723,8 @@ uint8_t MFRC522_read(MFRC522_t *dev, uint8_t blockAddr, uint8_t *recvData)
 	cmdBuffer[1] = blockAddr;
 	// Append CRC
 	MFRC522_calculate_crc(dev, cmdBuffer, 2, &cmdBuffer[2]);
+	MFRC522_set_bit_framing(dev, 0x00);
+	MFRC522_set_timer(dev, MFRC522_TIMER_DEFAULT);
 
 	uint8_t backData[18];
 	size_t backLen = sizeof(backData);
@@ -516,6 +752,8 @@ uint8_t MFRC522_write(
 	cmdBuffer[0] = 0xA0;
 	cmdBuffer[1] = blockAddr;
 	MFRC522_calculate_crc(dev, cmdBuffer, 2, &cmdBuffer[2]);
+	MFRC522_set_bit_framing(dev, 0x00);
+	MFRC522_set_timer(dev, MFRC522_TIMER_DEFAULT);
 
 	uint8_t backData[2];
 	size_t backLen = sizeof(backData);
@@ -9,6 +9,18 @@
 #define MFRC522_OK 0
 #define MFRC522_NOTAGERR 1
 #define MFRC522_ERR 2
+/* the chip never finished the command: it was reset or lost its setup */
+#define MFRC522_TIMEOUTERR 3
+/* several cards answered at once; the bits up to the collision are good */
+#define MFRC522_COLLERR 4
+
+/* bytes the chip's FIFO holds */
+#define MFRC522_FIFO_SIZE 64
+
+/* longest wait for a command, past the chip's own 15 ms receive timer */
+#ifndef MFRC522_TIMEOUT_MS
+#define MFRC522_TIMEOUT_MS 50
+#endif
 
 #define PCD_IDLE 0x00
 #define PCD_AUTHENT 0x0E
@@ -25,9 +37,15 @@
 #define PICC_ANTICOLL3 0x97
 #define PICC_AUTHENT1A 0x60
 #define PICC_AUTHENT1B 0x61
+#define PICC_HALT 0x50
+
+/* the first UID byte at a level that isn't the last, and its SAK bit */
+#define PICC_CASCADE_TAG 0x88
+#define PICC_SAK_CASCADE 0x04
 
 #define CommandReg 0x01
 #define CommIEnReg 0x02
+#define DivIEnReg 0x03
 #define CommIrqReg 0x04
 #define ErrorReg 0x06
 #define Status1Reg 0x07
@@ -46,8 +64,8 @@
 #define TReloadRegH 0x2C
 #define TReloadRegL 0x2D
 #define VersionReg 0x37
-#define CRCResultRegL 0x21
-#define CRCResultRegH 0x22
+#define CRCResultRegL 0x22
+#define CRCResultRegH 0x21
 
 #define DivIrqReg 0x05
 #define Status2Reg 0x08
@@ -57,6 +75,14 @@ typedef struct {
 	uint cs_pin;
 	uint rst_pin;
 	uint baudrate;
+	// last value written to BitFramingReg, so StartSend can be set and
+	// cleared without reading it back
+	uint8_t bit_framing;
+	// last value written to TReloadRegL, the receive timeout in timer ticks
+	uint8_t timer_reload;
+	// set by MFRC522_use_irq(): wait for the IRQ pin instead of polling
+	bool use_irq;
+	volatile bool irq_pending;
 } MFRC522_t;
 
 void MFRC522_init(MFRC522_t *dev, spi_inst_t *spi_port, uint cs_pin,
@@ -68,13 +94,18 @@ void MFRC522_reset(MFRC522_t *dev);
 
 void MFRC522_antenna_on(MFRC522_t *dev, bool on);
 
+void MFRC522_use_irq(MFRC522_t *dev, bool on);
+void MFRC522_irq_notify(MFRC522_t *dev);
+
 uint8_t MFRC522_request(MFRC522_t *dev, uint8_t mode, uint8_t *outBits);
 
 uint8_t MFRC522_anticoll(
 	MFRC522_t *dev, uint8_t antiCollVal, uint8_t *serialOut);
 
-uint8_t MFRC522_select_tag(
-	MFRC522_t *dev, const uint8_t *uid, uint8_t uid_size);
+uint8_t MFRC522_select_tag(MFRC522_t *dev, uint8_t antiCollVal,
+	const uint8_t *serial, uint8_t *sak);
+
+void MFRC522_halt(MFRC522_t *dev);
 
 uint8_t MFRC522_auth(MFRC522_t *dev, uint8_t authMode, uint8_t blockAddr,
 	const uint8_t *sectorKey, const uint8_t *uid);
@@ -0,0 +1,971 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "hardware/spi.h"
+#include "pico/stdlib.h"
+
+#include "mfrc522.h"
+#include "mfrc522_sim.h"
+#include "sys.h"
+
+/* carrier, and one bit at 106 kBd (128 carrier cycles) */
+#define SIM_FC_HZ 13560000ull
+#define SIM_BIT_NS 9440ull
+/* a card answers this long after the end of a frame */
+#define SIM_FDT_NS 86000ull
+/* chip select and call overhead per transaction */
+#define SIM_CS_NS 2000ull
+/* MFAuthent runs a few exchanges with the card */
+#define SIM_AUTH_NS 1000000ull
+
+#define SIM_GPIOS 32
+#define SIM_NEVER UINT64_MAX
+#define SIM_MINUTE_NS 60000000000ull
+#define SIM_WEEK_NS (7 * 24 * 60 * SIM_MINUTE_NS)
+
+/* a frame on air, bits LSB first within each byte */
+struct sim_frame {
+	uint8_t bytes[MFRC522_FIFO_SIZE + 2];
+	size_t bits;
+};
+
+enum sim_card_state {
+	SIM_CARD_IDLE,
+	SIM_CARD_READY,
+	SIM_CARD_ACTIVE,
+	SIM_CARD_HALT,
+};
+
+struct sim_card {
+	bool present;
+	uint8_t uid[10];
+	uint8_t len;
+	enum sim_card_state state;
+	/* cascade level, while READY */
+	uint8_t level;
+};
+
+static struct {
+	uint8_t regs[64];
+	uint8_t fifo[MFRC522_FIFO_SIZE];
+	size_t fifo_len;
+	bool powered;
+	/* pending events, SIM_NEVER when none */
+	uint64_t tx_done;
+	uint64_t rx_done;
+	uint64_t timer;
+	uint64_t crc_done;
+	uint64_t auth_done;
+	/* the answer being received, and where it collided (-1 if not) */
+	struct sim_frame rx;
+	int collision;
+	uint8_t rx_align;
+} chip;
+
+static struct sim_card cards[MFRC522_SIM_CARDS];
+
+static struct {
+	bool connected;
+	unsigned cs;
+	unsigned rst;
+	unsigned irq;
+	bool irq_wired;
+	bool irq_level;
+	bool pull_up[SIM_GPIOS];
+	uint32_t irq_events;
+	gpio_irq_callback_t callback;
+} pins;
+
+static struct {
+	uint32_t baudrate;
+	bool selected;
+	bool started;
+	bool read;
+	uint8_t reg;
+} bus;
+
+static uint64_t now_ns;
+/* local time since Monday 00:00 at now_ns 0, modulo a week */
+static uint64_t local_base_ns;
+static struct mfrc522_sim_stats stats;
+static uint64_t stats_since;
+/* CollPos of every collision since the stats were reset */
+static uint8_t coll_pos[32];
+static size_t coll_count;
+
+static bool frame_bit(const struct sim_frame *frame, size_t i)
+{
+	return frame->bytes[i / 8] >> (i % 8) & 1;
+}
+
+static void frame_put_bit(struct sim_frame *frame, size_t i, bool bit)
+{
+	if (bit) {
+		frame->bytes[i / 8] |= (uint8_t)(1 << (i % 8));
+	} else {
+		frame->bytes[i / 8] &= (uint8_t)~(1 << (i % 8));
+	}
+}
+
+static void frame_set(
+	struct sim_frame *frame, const uint8_t *bytes, size_t len)
+{
+	memcpy(frame->bytes, bytes, len);
+	frame->bits = len * 8;
+}
+
+/* air time of a frame with parity bits, SOF and EOF */
+static uint64_t frame_ns(size_t bits)
+{
+	return (bits + bits / 8 + 2) * SIM_BIT_NS;
+}
+
+/* CRC_A (ISO 14443-3), from `preset` */
+static uint16_t sim_crc(const uint8_t *data, size_t len, uint16_t preset)
+{
+	uint16_t crc = preset;
+	for (size_t i = 0; i < len; i++) {
+		uint8_t b = data[i] ^ (uint8_t)crc;
+		b ^= (uint8_t)(b << 4);
+		crc = (uint16_t)((crc >> 8) ^ (b << 8) ^ (b << 3) ^ (b >> 4));
+	}
+	return crc;
+}
+
+static bool crc_ok(const struct sim_frame *frame)
+{
+	size_t len = frame->bits / 8;
+	if (frame->bits % 8 || len < 3) {
+		return false;
+	}
+	uint16_t crc = sim_crc(frame->bytes, len - 2, 0x6363);
+	return frame->bytes[len - 2] == (uint8_t)crc
+		&& frame->bytes[len - 1] == (uint8_t)(crc >> 8);
+}
+
+static void append_crc(struct sim_frame *frame)
+{
+	size_t len = frame->bits / 8;
+	uint16_t crc = sim_crc(frame->bytes, len, 0x6363);
+	frame->bytes[len] = (uint8_t)crc;
+	frame->bytes[len + 1] = (uint8_t)(crc >> 8);
+	frame->bits += 16;
+}
+
+/*
+ * Cards
+ */
+
+static uint8_t card_levels(const struct sim_card *card)
+{
+	return card->len == 4 ? 1 : card->len == 7 ? 2 : 3;
+}
+
+/* the 4 UID bytes (or cascade tag and 3) and BCC the card sends at `level` */
+static void card_cascade(const struct sim_card *card, uint8_t level,
+	uint8_t *cl)
+{
+	const uint8_t *uid = &card->uid[level * 3];
+	if (level + 1 < card_levels(card)) {
+		cl[0] = PICC_CASCADE_TAG;
+		memcpy(&cl[1], uid, 3);
+	} else {
+		memcpy(cl, uid, 4);
+	}
+	cl[4] = cl[0] ^ cl[1] ^ cl[2] ^ cl[3];
+}
+
+/* anything unexpected sends a card back to IDLE, or HALT if it slept */
+static bool card_unexpected(struct sim_card *card)
+{
+	if (card->state != SIM_CARD_HALT) {
+		card->state = SIM_CARD_IDLE;
+	}
+	return false;
+}
+
+static bool card_select(struct sim_card *card, uint8_t level,
+	const struct sim_frame *tx, struct sim_frame *answer)
+{
+	uint8_t cl[5];
+	card_cascade(card, level, cl);
+	if (tx->bits != 9 * 8 || !crc_ok(tx)
+		|| memcmp(cl, &tx->bytes[2], 5) != 0) {
+		return card_unexpected(card);
+	}
+
+	uint8_t sak = 0x08; // MIFARE Classic 1K
+	if (level + 1 < card_levels(card)) {
+		sak = PICC_SAK_CASCADE;
+		card->level++;
+	} else {
+		card->state = SIM_CARD_ACTIVE;
+	}
+	frame_set(answer, &sak, 1);
+	append_crc(answer);
+	return true;
+}
+
+static bool card_anticoll(struct sim_card *card, const struct sim_frame *tx,
+	struct sim_frame *answer)
+{
+	uint8_t level = (uint8_t)((tx->bytes[0] - PICC_ANTICOLL1) / 2);
+	if (card->state != SIM_CARD_READY || card->level != level
+		|| tx->bits < 16) {
+		return card_unexpected(card);
+	}
+
+	uint8_t nvb = tx->bytes[1];
+	if (nvb == 0x70) {
+		return card_select(card, level, tx, answer);
+	}
+
+	size_t known = ((nvb >> 4) - 2) * 8 + (nvb & 0x0F);
+	if ((nvb >> 4) < 2 || known > 32 || tx->bits != 16 + known) {
+		return card_unexpected(card);
+	}
+
+	struct sim_frame cl;
+	card_cascade(card, level, cl.bytes);
+	cl.bits = 40;
+	for (size_t i = 0; i < known; i++) {
+		if (frame_bit(&cl, i) != frame_bit(tx, 16 + i)) {
+			// not this card; it waits for the next round
+			return false;
+		}
+	}
+
+	memset(answer->bytes, 0, sizeof(answer->bytes));
+	answer->bits = cl.bits - known;
+	for (size_t i = 0; i < answer->bits; i++) {
+		frame_put_bit(answer, i, frame_bit(&cl, known + i));
+	}
+	return true;
+}
+
+/* the card's answer to `tx`, if it has one */
+static bool card_receive(struct sim_card *card, const struct sim_frame *tx,
+	struct sim_frame *answer)
+{
+	if (tx->bits == 7) {
+		uint8_t cmd = tx->bytes[0] & 0x7F;
+		bool wake = cmd == PICC_REQALL;
+		if (cmd != PICC_REQIDL && !wake) {
+			return card_unexpected(card);
+		}
+		if (card->state != SIM_CARD_IDLE
+			&& !(wake && card->state == SIM_CARD_HALT)) {
+			return card_unexpected(card);
+		}
+		// ATQA: bits 7-6 give the UID size
+		uint8_t atqa[2] = {
+			(uint8_t)((card_levels(card) - 1) << 6 | 0x04), 0x00};
+		frame_set(answer, atqa, 2);
+		card->state = SIM_CARD_READY;
+		card->level = 0;
+		return true;
+	}
+
+	uint8_t cmd = tx->bytes[0];
+	if (cmd == PICC_ANTICOLL1 || cmd == PICC_ANTICOLL2
+		|| cmd == PICC_ANTICOLL3) {
+		return card_anticoll(card, tx, answer);
+	}
+	if (card->state != SIM_CARD_ACTIVE || !crc_ok(tx)) {
+		return card_unexpected(card);
+	}
+	if (cmd == PICC_HALT && tx->bits == 4 * 8) {
+		card->state = SIM_CARD_HALT;
+		return false;
+	}
+	if (cmd == 0x30 && tx->bits == 4 * 8) {
+		// MIFARE Read: blocks are filled with their number
+		uint8_t block[16];
+		memset(block, tx->bytes[1], sizeof(block));
+		frame_set(answer, block, sizeof(block));
+		append_crc(answer);
+		return true;
+	}
+	return card_unexpected(card);
+}
+
+/* the field went off: every card loses power and comes back IDLE */
+static void cards_power_cycle(void)
+{
+	for (size_t i = 0; i < MFRC522_SIM_CARDS; i++) {
+		cards[i].state = SIM_CARD_IDLE;
+	}
+}
+
+/*
+ * Send `tx` to every card in the field. Their answers overlap on air: a
+ * bit where they differ is a collision, and reads as 1.
+ */
+static bool cards_receive(const struct sim_frame *tx, struct sim_frame *rx,
+	int *collision)
+{
+	bool answered = false;
+	*collision = -1;
+	if (tx->bits < 7) {
+		return false;
+	}
+
+	for (size_t i = 0; i < MFRC522_SIM_CARDS; i++) {
+		struct sim_frame answer;
+		if (!cards[i].present
+			|| !card_receive(&cards[i], tx, &answer)) {
+			continue;
+		}
+		if (!answered) {
+			*rx = answer;
+			answered = true;
+			continue;
+		}
+
+		size_t bits = rx->bits > answer.bits ? rx->bits : answer.bits;
+		for (size_t b = 0; b < bits; b++) {
+			bool x = b < rx->bits && frame_bit(rx, b);
+			bool y = b < answer.bits && frame_bit(&answer, b);
+			if (x != y && (*collision < 0 || (int)b < *collision)) {
+				*collision = (int)b;
+			}
+			frame_put_bit(rx, b, x || y);
+		}
+		rx->bits = bits;
+	}
+	return answered;
+}
+
+/*
+ * Chip
+ */
+
+static void chip_update_irq(void)
+{
+	uint8_t *r = chip.regs;
+	bool asserted = (r[CommIEnReg] & r[CommIrqReg] & 0x7F)
+		|| (r[DivIEnReg] & r[DivIrqReg] & 0x14);
+	// IRqInv: active low
+	bool drive_low = (r[CommIEnReg] & 0x80) ? asserted : !asserted;
+	// open drain unless IRQPushPull
+	bool level = !drive_low && ((r[DivIEnReg] & 0x80)
+		|| pins.pull_up[pins.irq]);
+	if (!pins.irq_wired || !chip.powered) {
+		level = pins.pull_up[pins.irq];
+	}
+
+	uint32_t event = 0;
+	if (pins.irq_level && !level) {
+		event = GPIO_IRQ_EDGE_FALL;
+	} else if (!pins.irq_level && level) {
+		event = GPIO_IRQ_EDGE_RISE;
+	}
+	pins.irq_level = level;
+	if ((event & pins.irq_events) && pins.callback) {
+		stats.irqs++;
+		pins.callback(pins.irq, event);
+	}
+}
+
+static void chip_cancel(void)
+{
+	chip.tx_done = SIM_NEVER;
+	chip.rx_done = SIM_NEVER;
+	chip.timer = SIM_NEVER;
+	chip.crc_done = SIM_NEVER;
+	chip.auth_done = SIM_NEVER;
+}
+
+static void chip_reset(void)
+{
+	static const uint8_t defaults[][2] = {
+		{CommandReg, 0x20},
+		{CommIEnReg, 0x80},
+		{CommIrqReg, 0x14},
+		{Status1Reg, 0x21},
+		{ControlReg, 0x10},
+		{CollReg, 0xA0},
+		{ModeReg, 0x3F},
+		{TxControlReg, 0x80},
+		{VersionReg, 0x92},
+	};
+
+	memset(chip.regs, 0, sizeof(chip.regs));
+	for (size_t i = 0; i < sizeof(defaults) / sizeof(defaults[0]); i++) {
+		chip.regs[defaults[i][0]] = defaults[i][1];
+	}
+	chip.fifo_len = 0;
+	chip_cancel();
+	// the antenna is off after a reset
+	cards_power_cycle();
+	chip_update_irq();
+}
+
+static uint64_t chip_timer_ns(void)
+{
+	uint8_t *r = chip.regs;
+	uint64_t prescaler = (uint64_t)(r[TModeReg] & 0x0F) << 8
+		| r[TPrescalerReg];
+	uint64_t reload = (uint64_t)r[TReloadRegH] << 8 | r[TReloadRegL];
+	return (2 * prescaler + 1) * (reload + 1) * 1000000000ull / SIM_FC_HZ;
+}
+
+static void chip_transceive(void)
+{
+	uint8_t *r = chip.regs;
+	uint8_t last_bits = r[BitFramingReg] & 0x07;
+
+	struct sim_frame tx;
+	memcpy(tx.bytes, chip.fifo, chip.fifo_len);
+	tx.bits = chip.fifo_len * 8;
+	if (last_bits && chip.fifo_len) {
+		tx.bits -= 8 - last_bits;
+	}
+	chip.fifo_len = 0;
+	r[ErrorReg] = 0;
+	stats.frames++;
+
+	chip.rx_align = (r[BitFramingReg] >> 4) & 0x07;
+	chip.tx_done = now_ns + frame_ns(tx.bits);
+
+	bool answered = (r[TxControlReg] & 0x03)
+		&& cards_receive(&tx, &chip.rx, &chip.collision);
+	if (answered) {
+		// the timer stops at the first bit received
+		chip.rx_done =
+			chip.tx_done + SIM_FDT_NS + frame_ns(chip.rx.bits);
+	} else if (r[TModeReg] & 0x80) { // TAuto
+		chip.timer = chip.tx_done + chip_timer_ns();
+	}
+}
+
+static void chip_command(uint8_t cmd)
+{
+	uint8_t *r = chip.regs;
+	r[CommandReg] = (uint8_t)((r[CommandReg] & 0x30) | cmd);
+
+	switch (cmd) {
+	case PCD_IDLE:
+		chip_cancel();
+		break;
+	case PCD_CALCCRC: {
+		static const uint16_t presets[4] = {
+			0x0000, 0x6363, 0xA671, 0xFFFF};
+		uint16_t crc = sim_crc(chip.fifo, chip.fifo_len,
+			presets[r[ModeReg] & 0x03]);
+		r[CRCResultRegL] = (uint8_t)crc;
+		r[CRCResultRegH] = (uint8_t)(crc >> 8);
+		chip.crc_done = now_ns + (chip.fifo_len + 1) * 8 * 1000000000ull
+			/ SIM_FC_HZ;
+		chip.fifo_len = 0;
+		break;
+	}
+	case PCD_TRANSCEIVE:
+		r[ErrorReg] = 0;
+		if (r[BitFramingReg] & 0x80) {
+			chip_transceive();
+		}
+		break;
+	case PCD_AUTHENT:
+		r[ErrorReg] = 0;
+		chip.fifo_len = 0;
+		chip.auth_done = now_ns + SIM_AUTH_NS;
+		break;
+	case PCD_RESETPHASE:
+		chip_reset();
+		break;
+	default:
+		r[CommandReg] &= 0xF0;
+		break;
+	}
+}
+
+/* the answer arrived: into the FIFO from bit RxAlign on */
+static void chip_receive(void)
+{
+	uint8_t *r = chip.regs;
+	size_t total = chip.rx_align + chip.rx.bits;
+	size_t bytes = (total + 7) / 8;
+
+	uint8_t in[MFRC522_FIFO_SIZE + 2] = {0};
+	for (size_t i = 0; i < chip.rx.bits; i++) {
+		// ValuesAfterColl clear: everything from the collision is 0
+		if (chip.collision >= 0 && (int)i >= chip.collision
+			&& !(r[CollReg] & 0x80)) {
+			break;
+		}
+		if (frame_bit(&chip.rx, i)) {
+			size_t bit = chip.rx_align + i;
+			in[bit / 8] |= (uint8_t)(1 << (bit % 8));
+		}
+	}
+	for (size_t i = 0; i < bytes; i++) {
+		if (chip.fifo_len == MFRC522_FIFO_SIZE) {
+			r[ErrorReg] |= 0x10; // BufferOvfl
+			break;
+		}
+		chip.fifo[chip.fifo_len++] = in[i];
+	}
+
+	r[ControlReg] = (uint8_t)((r[ControlReg] & ~0x07) | (total % 8));
+	if (chip.collision >= 0) {
+		// CollPos counts from bit 0 of the first byte; 0 is the 32nd
+		r[ErrorReg] |= 0x08;
+		r[CollReg] = (uint8_t)((r[CollReg] & 0x80)
+			| ((chip.rx_align + chip.collision + 1) & 0x1F));
+		if (coll_count < sizeof(coll_pos)) {
+			coll_pos[coll_count++] = r[CollReg] & 0x1F;
+		}
+	} else {
+		r[CollReg] = (uint8_t)((r[CollReg] & 0x80) | 0x20);
+	}
+	r[CommIrqReg] |= 0x20; // RxIRq
+}
+
+static void chip_authenticated(void)
+{
+	uint8_t *r = chip.regs;
+	bool selected = false;
+	for (size_t i = 0; i < MFRC522_SIM_CARDS; i++) {
+		selected |= cards[i].present
+			&& cards[i].state == SIM_CARD_ACTIVE;
+	}
+	if (selected) {
+		r[Status2Reg] |= 0x08; // MFCrypto1On
+	} else {
+		r[ErrorReg] |= 0x01; // ProtocolErr
+	}
+	r[CommandReg] &= 0xF0;
+	r[CommIrqReg] |= 0x10; // IdleIRq
+}
+
+static uint64_t chip_next_event(void)
+{
+	uint64_t next = chip.tx_done;
+	uint64_t events[] = {
+		chip.rx_done, chip.timer, chip.crc_done, chip.auth_done};
+	for (size_t i = 0; i < sizeof(events) / sizeof(events[0]); i++) {
+		if (events[i] < next) {
+			next = events[i];
+		}
+	}
+	return next;
+}
+
+static void chip_fire(uint64_t t)
+{
+	uint8_t *r = chip.regs;
+	if (chip.tx_done == t) {
+		chip.tx_done = SIM_NEVER;
+		r[CommIrqReg] |= 0x40; // TxIRq
+	}
+	if (chip.rx_done == t) {
+		chip.rx_done = SIM_NEVER;
+		chip_receive();
+	}
+	if (chip.timer == t) {
+		chip.timer = SIM_NEVER;
+		r[CommIrqReg] |= 0x01; // TimerIRq
+	}
+	if (chip.crc_done == t) {
+		chip.crc_done = SIM_NEVER;
+		r[DivIrqReg] |= 0x04; // CRCIRq
+	}
+	if (chip.auth_done == t) {
+		chip.auth_done = SIM_NEVER;
+		chip_authenticated();
+	}
+	chip_update_irq();
+}
+
+static uint8_t chip_read(uint8_t reg)
+{
+	if (!chip.powered) {
+		return 0;
+	}
+	if (reg == FIFODataReg) {
+		if (chip.fifo_len == 0) {
+			return 0;
+		}
+		uint8_t value = chip.fifo[0];
+		memmove(chip.fifo, &chip.fifo[1], --chip.fifo_len);
+		return value;
+	}
+	if (reg == FIFOLevelReg) {
+		return (uint8_t)chip.fifo_len;
+	}
+	return chip.regs[reg];
+}
+
+static void chip_write(uint8_t reg, uint8_t value)
+{
+	uint8_t *r = chip.regs;
+	if (!chip.powered) {
+		return;
+	}
+
+	switch (reg) {
+	case CommandReg:
+		// RcvOff and PowerDown, then the command
+		r[reg] = (uint8_t)((r[reg] & 0x0F) | (value & 0x30));
+		chip_command(value & 0x0F);
+		break;
+	case CommIrqReg:
+		// Set1: set the marked bits, else clear them
+		r[reg] = (value & 0x80) ? r[reg] | (value & 0x7F)
+					: r[reg] & ~(value & 0x7F);
+		break;
+	case DivIrqReg:
+		r[reg] = (value & 0x80) ? r[reg] | (value & 0x14)
+					: r[reg] & ~(value & 0x14);
+		break;
+	case FIFODataReg:
+		if (chip.fifo_len == MFRC522_FIFO_SIZE) {
+			r[ErrorReg] |= 0x10; // BufferOvfl
+		} else {
+			chip.fifo[chip.fifo_len++] = value;
+		}
+		break;
+	case FIFOLevelReg:
+		if (value & 0x80) { // FlushBuffer
+			chip.fifo_len = 0;
+			r[ErrorReg] &= ~0x10;
+		}
+		break;
+	case BitFramingReg:
+		r[reg] = value;
+		// StartSend
+		if ((value & 0x80)
+			&& (r[CommandReg] & 0x0F) == PCD_TRANSCEIVE) {
+			chip_transceive();
+		}
+		break;
+	case TxControlReg:
+		if ((r[reg] & 0x03) && !(value & 0x03)) {
+			cards_power_cycle();
+		}
+		r[reg] = value;
+		break;
+	case CollReg:
+		r[reg] = (uint8_t)((r[reg] & 0x7F) | (value & 0x80));
+		break;
+	case Status2Reg:
+		// MFCrypto1On can only be cleared by software
+		r[reg] = (uint8_t)((value & 0xC0) | (r[reg] & value & 0x08)
+			| (r[reg] & 0x07));
+		break;
+	case ErrorReg:
+	case Status1Reg:
+	case ControlReg:
+	case CRCResultRegL:
+	case CRCResultRegH:
+	case VersionReg:
+		break;
+	default:
+		r[reg] = value;
+		break;
+	}
+	chip_update_irq();
+}
+
+/*
+ * Time
+ */
+
+static void sim_advance_to(uint64_t t)
+{
+	for (uint64_t next = chip_next_event(); next <= t;
+		next = chip_next_event()) {
+		if (next > now_ns) {
+			now_ns = next;
+		}
+		chip_fire(next);
+	}
+	if (t > now_ns) {
+		now_ns = t;
+	}
+}
+
+absolute_time_t get_absolute_time(void)
+{
+	return now_ns / 1000;
+}
+
+absolute_time_t make_timeout_time_ms(uint32_t ms)
+{
+	return now_ns / 1000 + (uint64_t)ms * 1000;
+}
+
+uint32_t to_ms_since_boot(absolute_time_t t)
+{
+	return (uint32_t)(t / 1000);
+}
+
+bool time_reached(absolute_time_t t)
+{
+	return now_ns / 1000 >= t;
+}
+
+/*
+ * Sleep until the chip's next event or the timeout, whichever comes first;
+ * an IRQ edge on the way runs the GPIO callback.
+ */
+bool best_effort_wfe_or_timeout(absolute_time_t timeout)
+{
+	uint64_t next = chip_next_event();
+	if (next < timeout * 1000) {
+		sim_advance_to(next);
+		return false;
+	}
+	sim_advance_to(timeout * 1000);
+	return true;
+}
+
+void sleep_us(uint64_t us)
+{
+	sim_advance_to(now_ns + us * 1000);
+}
+
+void sleep_ms(uint32_t ms)
+{
+	sleep_us((uint64_t)ms * 1000);
+}
+
+/*
+ * sys_local_time() in place of sys.c's, which reads the host clock: the
+ * virtual time, starting on Monday 00:00 unless mfrc522_sim_set_local_time()
+ * moved it.
+ */
+int sys_local_time(unsigned *weekday, unsigned *minute)
+{
+	uint64_t week_minute =
+		(local_base_ns + now_ns) % SIM_WEEK_NS / SIM_MINUTE_NS;
+	*weekday = (unsigned)(week_minute / (24 * 60));
+	*minute = (unsigned)(week_minute % (24 * 60));
+	return 0;
+}
+
+/*
+ * GPIO
+ */
+
+void gpio_init(unsigned gpio)
+{
+	(void)gpio;
+}
+
+void gpio_set_dir(unsigned gpio, bool out)
+{
+	(void)gpio;
+	(void)out;
+}
+
+void gpio_set_function(unsigned gpio, int fn)
+{
+	(void)gpio;
+	(void)fn;
+}
+
+void gpio_pull_up(unsigned gpio)
+{
+	if (gpio < SIM_GPIOS) {
+		pins.pull_up[gpio] = true;
+	}
+	if (pins.connected && gpio == pins.irq) {
+		chip_update_irq();
+	}
+}
+
+void gpio_set_irq_enabled_with_callback(unsigned gpio, uint32_t event_mask,
+	bool enabled, gpio_irq_callback_t callback)
+{
+	pins.callback = callback;
+	if (pins.connected && gpio == pins.irq) {
+		pins.irq_events = enabled ? event_mask : 0;
+	}
+}
+
+void gpio_put(unsigned gpio, bool value)
+{
+	if (!pins.connected) {
+		return;
+	}
+	if (gpio == pins.cs) {
+		if (!value && !bus.selected) {
+			bus.selected = true;
+			bus.started = false;
+			stats.transactions++;
+			stats.bus_ns += SIM_CS_NS;
+			sim_advance_to(now_ns + SIM_CS_NS);
+		}
+		bus.selected = !value;
+	} else if (gpio == pins.rst) {
+		if (value && !chip.powered) {
+			chip.powered = true;
+			chip_reset();
+		} else if (!value && chip.powered) {
+			// hard power down
+			chip_reset();
+			chip.powered = false;
+		}
+	}
+}
+
+/*
+ * SPI
+ */
+
+uint spi_init(spi_inst_t *spi, uint baudrate)
+{
+	(void)spi;
+	bus.baudrate = baudrate ? baudrate : 1;
+	return baudrate;
+}
+
+void spi_set_format(spi_inst_t *spi, uint data_bits, spi_cpol_t cpol,
+	spi_cpha_t cpha, spi_order_t order)
+{
+	(void)spi;
+	(void)data_bits;
+	(void)cpol;
+	(void)cpha;
+	(void)order;
+}
+
+/*
+ * Clock one byte. The first byte of a transaction is an address: a write
+ * sends every byte after it to that register, a read answers each byte
+ * with the register the byte before it named.
+ */
+static uint8_t spi_byte(uint8_t mosi)
+{
+	uint8_t miso = 0;
+	if (!bus.selected) {
+		return 0;
+	}
+
+	uint64_t byte_ns = 8 * 1000000000ull / bus.baudrate;
+	stats.bytes++;
+	stats.bus_ns += byte_ns;
+	sim_advance_to(now_ns + byte_ns);
+
+	if (!bus.started) {
+		bus.started = true;
+		bus.read = mosi & 0x80;
+	} else if (bus.read) {
+		miso = chip_read(bus.reg);
+	} else {
+		chip_write(bus.reg, mosi);
+		return 0;
+	}
+	bus.reg = (mosi >> 1) & 0x3F;
+	return miso;
+}
+
+int spi_write_blocking(spi_inst_t *spi, const uint8_t *src, size_t len)
+{
+	(void)spi;
+	for (size_t i = 0; i < len; i++) {
+		spi_byte(src[i]);
+	}
+	return (int)len;
+}
+
+int spi_write_read_blocking(
+	spi_inst_t *spi, const uint8_t *src, uint8_t *dst, size_t len)
+{
+	(void)spi;
+	for (size_t i = 0; i < len; i++) {
+		dst[i] = spi_byte(src[i]);
+	}
+	return (int)len;
+}
+
+/*
+ * Simulator control
+ */
+
+/*
+ * Wire the chip to these GPIOs; call before the driver's MFRC522_init.
+ * With `irq_wired` false the IRQ pin is left unconnected, as on a board
+ * without the wire.
+ */
+void mfrc522_sim_connect(
+	unsigned cs_pin, unsigned rst_pin, unsigned irq_pin, bool irq_wired)
+{
+	pins.connected = true;
+	pins.cs = cs_pin;
+	pins.rst = rst_pin;
+	pins.irq = irq_pin;
+	pins.irq_wired = irq_wired;
+	pins.irq_level = pins.pull_up[irq_pin % SIM_GPIOS];
+	chip.powered = false;
+	chip_cancel();
+}
+
+/*
+ * Put a card with a 4, 7 or 10 byte UID in the field. Returns its handle,
+ * or -1 if the field is full or the UID size is wrong.
+ */
+int mfrc522_sim_add_card(const uint8_t *uid, size_t len)
+{
+	if (len != 4 && len != 7 && len != 10) {
+		return -1;
+	}
+	for (int i = 0; i < MFRC522_SIM_CARDS; i++) {
+		if (!cards[i].present) {
+			cards[i].present = true;
+			memcpy(cards[i].uid, uid, len);
+			cards[i].len = (uint8_t)len;
+			cards[i].state = SIM_CARD_IDLE;
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* take the card out of the field */
+void mfrc522_sim_remove_card(int card)
+{
+	if (card >= 0 && card < MFRC522_SIM_CARDS) {
+		cards[card].present = false;
+	}
+}
+
+void mfrc522_sim_stats_reset(void)
+{
+	memset(&stats, 0, sizeof(stats));
+	stats_since = now_ns;
+	coll_count = 0;
+}
+
+void mfrc522_sim_stats_get(struct mfrc522_sim_stats *out)
+{
+	*out = stats;
+	out->elapsed_ns = now_ns - stats_since;
+}
+
+/*
+ * Copy the CollPos the chip reported for each collision since
+ * mfrc522_sim_stats_reset(), oldest first, to `out`. Returns how many
+ * there were, at most `max`.
+ */
+size_t mfrc522_sim_collisions(uint8_t *out, size_t max)
+{
+	size_t n = coll_count < max ? coll_count : max;
+	memcpy(out, coll_pos, n);
+	return n;
+}
+
+uint64_t mfrc522_sim_now_ns(void)
+{
+	return now_ns;
+}
+
+void mfrc522_sim_set_local_time(unsigned weekday, unsigned minute)
+{
+	uint64_t local = ((uint64_t)weekday * 24 * 60 + minute) * SIM_MINUTE_NS;
+	local %= SIM_WEEK_NS;
+	local_base_ns = local + SIM_WEEK_NS - now_ns % SIM_WEEK_NS;
+	local_base_ns %= SIM_WEEK_NS;
+}
@@ -0,0 +1,52 @@
+#ifndef MFRC522_SIM_H
+#define MFRC522_SIM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A register-level MFRC522 for the Linux build, behind the SPI, GPIO and
+ * time calls in src/sys/sim/. It models the register file, the FIFO, the
+ * timer, CRC coprocessor and IRQ pin, and ISO 14443-A cards in the field
+ * down to bitwise anticollision, so the driver and rfid_reader.c run
+ * unchanged.
+ *
+ * It also stands in for sys_local_time(), so the simulated clock decides
+ * when the reader polls at its busy-hours rate, not the host's.
+ *
+ * Not modeled: Hi/LoAlert, MIFARE crypto (MFAuthent succeeds whenever a
+ * card is selected) and anything above 106 kBd.
+ */
+#ifndef MFRC522_SIM_CARDS
+#define MFRC522_SIM_CARDS 16
+#endif
+
+struct mfrc522_sim_stats {
+	/* chip selects, and bytes clocked over SPI */
+	uint32_t transactions;
+	uint32_t bytes;
+	/* modeled SPI time, chip select overhead included */
+	uint64_t bus_ns;
+	/* frames sent to the cards, and IRQ pin edges the GPIO saw */
+	uint32_t frames;
+	uint32_t irqs;
+	/* virtual time that passed */
+	uint64_t elapsed_ns;
+};
+
+void mfrc522_sim_connect(
+	unsigned cs_pin, unsigned rst_pin, unsigned irq_pin, bool irq_wired);
+int mfrc522_sim_add_card(const uint8_t *uid, size_t len);
+void mfrc522_sim_remove_card(int card);
+void mfrc522_sim_stats_reset(void);
+void mfrc522_sim_stats_get(struct mfrc522_sim_stats *stats);
+size_t mfrc522_sim_collisions(uint8_t *out, size_t max);
+uint64_t mfrc522_sim_now_ns(void);
+/*
+ * Set the local time sys_local_time() reports from now on: day of the week
+ * (0 is Monday) and minutes since midnight. It advances with virtual time.
+ */
+void mfrc522_sim_set_local_time(unsigned weekday, unsigned minute);
+
+#endif // MFRC522_SIM_H
@@ -95,6 +95,35 @@ size_t fs_write_data(File file, const void *ptr, size_t size) {
 	return (size_t)bw;
 }
 
+int fs_rename(const char *old_path, const char *new_path) {
+	int err = lfs_rename(&lfs, old_path, new_path);
+	if (err < 0) {
+		printf("[fs_rename] Error renaming '%s', err=%d\n", old_path,
+			err);
+		return -1;
+	}
+	return 0;
+}
+
+int fs_remove(const char *path) {
+	int err = lfs_remove(&lfs, path);
+	if (err < 0) {
+		printf("[fs_remove] Error removing '%s', err=%d\n", path, err);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * littlefs files are not contiguous in flash, so they can't be mapped.
+ */
+const void *fs_map(const char *path, size_t *size) {
+	return NULL;
+}
+
+void fs_unmap(const void *ptr, size_t size) {
+}
+
 void fs_print_contents(void) {
 	lfs_dir_t dir;
 	int err = lfs_dir_open(&lfs, &dir, "/");
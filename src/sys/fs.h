@@ -5,13 +5,29 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#ifndef WITH_FS
 #define WITH_FS 0
+#endif
+
 #ifdef __PICO_BUILD__
 /*#include <lfs.h>*/
+#if WITH_FS
+#define FS_O_RDONLY LFS_O_RDONLY
+#define FS_O_WRONLY LFS_O_WRONLY
+#define FS_O_CREAT LFS_O_CREAT
+#define FS_O_TRUNC LFS_O_TRUNC
+#define FS_O_APPEND LFS_O_APPEND
+#endif
 
 #else // Linux
 #include <fcntl.h>
 
+#define FS_O_RDONLY O_RDONLY
+#define FS_O_WRONLY O_WRONLY
+#define FS_O_CREAT O_CREAT
+#define FS_O_TRUNC O_TRUNC
+#define FS_O_APPEND O_APPEND
+
 #endif
 
 #ifdef __PICO_BUILD__
@@ -33,6 +49,10 @@ File fs_open(const char *path, int flags);
 int fs_close(File file);
 size_t fs_read_data(File file, void *ptr, size_t size);
 size_t fs_write_data(File file, const void *ptr, size_t size);
+int fs_rename(const char *old_path, const char *new_path);
+int fs_remove(const char *path);
+const void *fs_map(const char *path, size_t *size);
+void fs_unmap(const void *ptr, size_t size);
 void fs_print_contents(void);
 
 #endif // FS_H
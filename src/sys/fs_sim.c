@@ -6,6 +6,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 void fs_init(void)
@@ -67,6 +69,60 @@ size_t fs_write_data(File file, const void *ptr, size_t size)
 	}
 	return (size_t)bw;
 }
+
+int fs_rename(const char *old_path, const char *new_path)
+{
+	if (rename(old_path, new_path) < 0) {
+		perror("[fs_rename] rename failed");
+		return -1;
+	}
+	return 0;
+}
+
+int fs_remove(const char *path)
+{
+	if (unlink(path) < 0) {
+		perror("[fs_remove] unlink failed");
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Map a whole file read-only. Returns NULL if it doesn't exist or is empty.
+ */
+const void *fs_map(const char *path, size_t *size)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size == 0) {
+		close(fd);
+		return NULL;
+	}
+
+	void *ptr =
+		mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (ptr == MAP_FAILED) {
+		perror("[fs_map] mmap failed");
+		return NULL;
+	}
+
+	*size = (size_t)st.st_size;
+	return ptr;
+}
+
+void fs_unmap(const void *ptr, size_t size)
+{
+	if (ptr) {
+		munmap((void *)ptr, size);
+	}
+}
+
 void fs_print_contents(void)
 {
 }
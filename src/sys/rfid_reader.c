@@ -4,16 +4,20 @@
 
 #include "device/mfrc522.h"
 #include "rfid_reader.h"
+#include "sys.h"
 
 #define MFRC522_SPI_PORT spi0
-#define PIN_MISO 4
-#define PIN_MOSI 3
-#define PIN_SCK 2
-#define PIN_CS 1
-#define PIN_RST 0
 
 MFRC522_t rfid;
 
+static void rfid_irq(uint gpio, uint32_t events)
+{
+	(void)events;
+	if (gpio == RFID_PIN_IRQ) {
+		MFRC522_irq_notify(&rfid);
+	}
+}
+
 void rfid_reader_init(struct rfid_reader *reader)
 {
 	if (!reader) {
@@ -21,72 +25,199 @@ void rfid_reader_init(struct rfid_reader *reader)
 		return;
 	}
 
-	MFRC522_init(&rfid, MFRC522_SPI_PORT, PIN_CS, PIN_RST, PIN_SCK,
-		PIN_MOSI, PIN_MISO, 1000 * 1000);
+	MFRC522_init(&rfid, MFRC522_SPI_PORT, RFID_PIN_CS, RFID_PIN_RST,
+		RFID_PIN_SCK, RFID_PIN_MOSI, RFID_PIN_MISO, 1000 * 1000);
+
+	// the pull-up keeps the line quiet if IRQ isn't wired, and the
+	// driver falls back to polling
+	gpio_init(RFID_PIN_IRQ);
+	gpio_set_dir(RFID_PIN_IRQ, GPIO_IN);
+	gpio_pull_up(RFID_PIN_IRQ);
+	gpio_set_irq_enabled_with_callback(
+		RFID_PIN_IRQ, GPIO_IRQ_EDGE_FALL, true, rfid_irq);
+	MFRC522_use_irq(&rfid, true);
+	reader->state = RFID_READER_IDLE;
+	reader->armed = true;
+	reader->next_poll_ms = 0;
+	reader->last_card_ms = 0;
+	reader->reported = false;
 
 	memset(reader->key_a, 0xFF, sizeof(reader->key_a));
 
 	printf("RFID reader initialized.\n");
 }
 
-int rfid_reader_wait_for_card(struct rfid_reader *reader, int timeout_ms)
+static uint32_t rfid_reader_poll_interval(
+	struct rfid_reader *reader, uint32_t now)
 {
-	if (!reader) {
-		fprintf(stderr, "Error: rfid_reader pointer is NULL\n");
-		return -1;
+	if (now - reader->last_card_ms < RFID_RECENT_MS) {
+		return RFID_POLL_FAST_MS;
 	}
 
-	uint8_t status;
-	uint8_t outBits;
-	int elapsed_time = 0;
-
-	while (elapsed_time < timeout_ms) {
-		MFRC522_wake(&rfid);
-		status = MFRC522_request(&rfid, PICC_REQIDL, &outBits);
+	unsigned weekday;
+	unsigned minute;
+	if (sys_local_time(&weekday, &minute) == 0
+		&& minute >= RFID_BUSY_FROM && minute < RFID_BUSY_UNTIL) {
+		return RFID_POLL_FAST_MS;
+	}
+	return RFID_POLL_IDLE_MS;
+}
 
-		if (status == MFRC522_OK) {
-			/*printf("Card detected!\n");*/
-			return 0;
-		}
+static void rfid_reader_idle(struct rfid_reader *reader, uint32_t now)
+{
+	reader->state = RFID_READER_IDLE;
+	reader->next_poll_ms = now + rfid_reader_poll_interval(reader, now);
+}
 
-		sleep_ms(100);
-		elapsed_time += 100;
+/* append `n` UID bytes, counting but dropping those that don't fit */
+static void rfid_reader_keep(
+	struct rfid_reader *reader, const uint8_t *bytes, uint8_t n)
+{
+	if (reader->uid_len + n <= sizeof(reader->uid_bytes)) {
+		memcpy(&reader->uid_bytes[reader->uid_len], bytes, n);
 	}
+	reader->uid_len += n;
+}
 
-	/*printf("No card detected within timeout.\n");*/
-	return -1;
+/*
+ * Whether to log a failed read: a card that can't be read is only reported
+ * once while it stays in the field.
+ */
+static bool rfid_reader_report(struct rfid_reader *reader)
+{
+	bool first = !reader->reported;
+	reader->reported = true;
+	return first;
 }
 
-int rfid_reader_read(struct rfid_reader *reader, char *uid)
+/*
+ * Run the next step of reading the cards in the field and return. A step
+ * is one exchange with a card (anticollision takes one more frame per
+ * colliding bit), so a call is bounded by the chip's receive timeout.
+ *
+ * Every card read is halted, and the REQA after it finds the next one in
+ * the field, so a wallet full of cards is read in one pass, one UID per
+ * call, and nobody is read twice while they stay in the field. A card that
+ * fails is halted too; one that keeps failing is logged once, and only a
+ * read keeps the poll rate up.
+ *
+ * The chip keeps its setup between polls; it is only woken again after it
+ * stops answering (a brown-out or reset loses the timer setup, so commands
+ * never finish).
+ *
+ * Returns 1 when a card was read into `uid`, -1 if a card was seen but
+ * couldn't be read, and 0 otherwise.
+ */
+int rfid_reader_poll(struct rfid_reader *reader, struct uid *uid)
 {
+	static const uint8_t cascade[] = {
+		PICC_ANTICOLL1, PICC_ANTICOLL2, PICC_ANTICOLL3};
+
 	if (!reader || !uid) {
 		fprintf(stderr,
-			"Error: Invalid arguments to rfid_reader_read\n");
+			"Error: Invalid arguments to rfid_reader_poll\n");
 		return -1;
 	}
 
+	uint32_t now = to_ms_since_boot(get_absolute_time());
 	uint8_t status;
-	uint8_t serial[5] = {0};
+	uint8_t outBits;
+	uint8_t sak;
+
+	switch (reader->state) {
+	case RFID_READER_IDLE:
+		if (!reader->armed) {
+			MFRC522_wake(&rfid);
+			reader->armed = true;
+		} else if ((int32_t)(now - reader->next_poll_ms) >= 0) {
+			reader->state = RFID_READER_REQA;
+		}
+		return 0;
+
+	case RFID_READER_REQA:
+		status = MFRC522_request(&rfid, PICC_REQIDL, &outBits);
+		if (status == MFRC522_OK) {
+			reader->level = 0;
+			reader->uid_len = 0;
+			reader->state = RFID_READER_ANTICOLL;
+			return 0;
+		}
+		reader->reported = false;
+		if (status == MFRC522_TIMEOUTERR) {
+			printf("[RFID] Reader stopped answering, waking it.\n");
+			reader->armed = false;
+		}
+		rfid_reader_idle(reader, now);
+		return 0;
+
+	case RFID_READER_ANTICOLL:
+		status = MFRC522_anticoll(
+			&rfid, cascade[reader->level], reader->serial);
+		if (status != MFRC522_OK) {
+			if (rfid_reader_report(reader)) {
+				fprintf(stderr, "Error reading card.\n");
+			}
+			reader->state = RFID_READER_ERROR;
+			return -1;
+		}
+		reader->state = RFID_READER_SELECT;
+		return 0;
 
-	status = MFRC522_anticoll(&rfid, PICC_ANTICOLL1, serial);
-	if (status == MFRC522_OK) {
-		printf("UID: ");
-		for (int i = 0; i < 5; i++) {
-			printf("%02X ", serial[i]);
+	case RFID_READER_SELECT:
+		status = MFRC522_select_tag(
+			&rfid, cascade[reader->level], reader->serial, &sak);
+		if (status != MFRC522_OK) {
+			reader->state = RFID_READER_ERROR;
+			return -1;
 		}
-		printf("\n");
 
-		for (int i = 0; i < 5; i++) {
-			sprintf(&uid[i * 2], "%02x", serial[i]);
+		if (sak & PICC_SAK_CASCADE) {
+			// the cascade tag, then 3 bytes; the rest is a level on
+			if (reader->serial[0] != PICC_CASCADE_TAG
+				|| reader->level + 1 == sizeof(cascade)) {
+				if (rfid_reader_report(reader)) {
+					fprintf(stderr,
+						"Error: Bad cascade level.\n");
+				}
+				reader->state = RFID_READER_ERROR;
+				return -1;
+			}
+			rfid_reader_keep(reader, &reader->serial[1], 3);
+			reader->level++;
+			reader->state = RFID_READER_ANTICOLL;
+			return 0;
+		}
+		// serial[4] is the BCC, already checked by anticollision
+		rfid_reader_keep(reader, reader->serial, 4);
+
+		// the card is selected now; DONE halts it, read or not
+		reader->state = RFID_READER_DONE;
+		if (reader->uid_len > sizeof(reader->uid_bytes)) {
+			if (rfid_reader_report(reader)) {
+				fprintf(stderr,
+					"[RFID] UID longer than %d bytes.\n",
+					UID_MAX_BYTES);
+			}
+			return -1;
+		}
+		if (uid_set(uid, reader->uid_bytes, reader->uid_len) != 0) {
+			fprintf(stderr, "Error: UID too long to store.\n");
+			return -1;
 		}
-		uid[10] = '\0';
+		reader->last_card_ms = now;
+		return 1;
 
-		reader->uid_len = 5;
+	case RFID_READER_DONE:
+		// look for the next card straight away
+		MFRC522_halt(&rfid);
+		reader->state = RFID_READER_REQA;
+		return 0;
 
+	case RFID_READER_ERROR:
+		MFRC522_halt(&rfid);
 		MFRC522_stop_crypto1(&rfid);
+		rfid_reader_idle(reader, now);
 		return 0;
 	}
-
-	fprintf(stderr, "Error reading card.\n");
-	return -1;
+	return 0;
 }
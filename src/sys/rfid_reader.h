@@ -1,15 +1,83 @@
 #ifndef RFID_READER_H
 #define RFID_READER_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
+#include "uid.h"
+
+/* the Pico GPIOs the MFRC522 is wired to, as in the README */
+#define RFID_PIN_MISO 4
+#define RFID_PIN_MOSI 3
+#define RFID_PIN_SCK 2
+#define RFID_PIN_CS 1
+#define RFID_PIN_RST 0
+#define RFID_PIN_IRQ 5
+
+/*
+ * Milliseconds between REQAs: fast for RFID_RECENT_MS after a read (the
+ * next person in line) and between RFID_BUSY_FROM and RFID_BUSY_UNTIL
+ * (minutes of the day, when the clock is known), slow otherwise.
+ */
+#ifndef RFID_POLL_FAST_MS
+#define RFID_POLL_FAST_MS 10
+#endif
+#ifndef RFID_POLL_IDLE_MS
+#define RFID_POLL_IDLE_MS 50
+#endif
+#ifndef RFID_RECENT_MS
+#define RFID_RECENT_MS (30 * 1000)
+#endif
+#ifndef RFID_BUSY_FROM
+#define RFID_BUSY_FROM (17 * 60)
+#endif
+#ifndef RFID_BUSY_UNTIL
+#define RFID_BUSY_UNTIL (23 * 60)
+#endif
+
+/* the step rfid_reader_poll() runs next */
+enum rfid_reader_state {
+	/* waiting for the next REQA, waking the chip first if needed */
+	RFID_READER_IDLE,
+	RFID_READER_REQA,
+	RFID_READER_ANTICOLL,
+	RFID_READER_SELECT,
+	/* a UID was returned; halt the card and look for the next one */
+	RFID_READER_DONE,
+	/* the read failed; halt the card and go back to idle */
+	RFID_READER_ERROR,
+};
+
+/*
+ * ISO 14443-A cascade levels whose UID bytes are kept: 1, 2 or 3 for UIDs
+ * of 4, 7 or 10 bytes, as many as UID_MAX_BYTES can hold. A card with a
+ * longer UID is still selected, so it can be halted, and reported as a
+ * failed read.
+ */
+#define RFID_READER_LEVELS ((UID_MAX_BYTES - 1) / 3)
+
+#if RFID_READER_LEVELS < 1 || RFID_READER_LEVELS > 3
+#error "UID_MAX_BYTES must be from 4 to 10"
+#endif
+
 struct rfid_reader {
 	uint8_t uid_len;
 	uint8_t key_a[6];
+	enum rfid_reader_state state;
+	/* configured; only cleared when the chip stops answering */
+	bool armed;
+	uint32_t next_poll_ms;
+	uint32_t last_card_ms;
+	/* a failed read was logged since no card answered a REQA */
+	bool reported;
+	/* the cascade level being read, and its anticollision answer */
+	uint8_t level;
+	uint8_t serial[5];
+	/* the UID so far; uid_len counts the bytes that didn't fit too */
+	uint8_t uid_bytes[RFID_READER_LEVELS * 3 + 1];
 };
 
 void rfid_reader_init(struct rfid_reader *reader);
-int rfid_reader_wait_for_card(struct rfid_reader *reader, int timeout_ms);
-int rfid_reader_read(struct rfid_reader *reader, char *uid);
+int rfid_reader_poll(struct rfid_reader *reader, struct uid *uid);
 
 #endif // RFID_READER_H
@@ -0,0 +1,29 @@
+#ifndef SIM_HARDWARE_SPI_H
+#define SIM_HARDWARE_SPI_H
+
+/*
+ * The part of the Pico SDK's hardware/spi.h the MFRC522 driver uses, for
+ * the Linux build. The bus ends in the simulated chip in
+ * device/mfrc522_sim.c.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned int uint;
+typedef struct spi_inst spi_inst_t;
+
+#define spi0 ((spi_inst_t *)0)
+#define spi1 ((spi_inst_t *)1)
+
+typedef enum { SPI_CPOL_0, SPI_CPOL_1 } spi_cpol_t;
+typedef enum { SPI_CPHA_0, SPI_CPHA_1 } spi_cpha_t;
+typedef enum { SPI_LSB_FIRST, SPI_MSB_FIRST } spi_order_t;
+
+uint spi_init(spi_inst_t *spi, uint baudrate);
+void spi_set_format(spi_inst_t *spi, uint data_bits, spi_cpol_t cpol,
+	spi_cpha_t cpha, spi_order_t order);
+int spi_write_blocking(spi_inst_t *spi, const uint8_t *src, size_t len);
+int spi_write_read_blocking(
+	spi_inst_t *spi, const uint8_t *src, uint8_t *dst, size_t len);
+
+#endif // SIM_HARDWARE_SPI_H
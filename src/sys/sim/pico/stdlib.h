@@ -0,0 +1,43 @@
+#ifndef SIM_PICO_STDLIB_H
+#define SIM_PICO_STDLIB_H
+
+/*
+ * The GPIO and time calls of the Pico SDK the reader uses, for the Linux
+ * build. Time is virtual: it only moves when the code sleeps, waits or
+ * clocks bytes over SPI, so runs are repeatable and measure the modeled
+ * bus and air time rather than the host.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hardware/spi.h"
+
+/* microseconds since boot */
+typedef uint64_t absolute_time_t;
+
+#define GPIO_OUT 1
+#define GPIO_IN 0
+#define GPIO_FUNC_SPI 1
+
+#define GPIO_IRQ_EDGE_FALL 0x4u
+#define GPIO_IRQ_EDGE_RISE 0x8u
+
+typedef void (*gpio_irq_callback_t)(uint gpio, uint32_t event_mask);
+
+void gpio_init(uint gpio);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_set_function(uint gpio, int fn);
+void gpio_pull_up(uint gpio);
+void gpio_put(uint gpio, bool value);
+void gpio_set_irq_enabled_with_callback(uint gpio, uint32_t event_mask,
+	bool enabled, gpio_irq_callback_t callback);
+
+absolute_time_t get_absolute_time(void);
+absolute_time_t make_timeout_time_ms(uint32_t ms);
+uint32_t to_ms_since_boot(absolute_time_t t);
+bool time_reached(absolute_time_t t);
+bool best_effort_wfe_or_timeout(absolute_time_t timeout);
+void sleep_ms(uint32_t ms);
+void sleep_us(uint64_t us);
+
+#endif // SIM_PICO_STDLIB_H
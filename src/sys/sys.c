@@ -32,13 +32,25 @@ void sys_run(callback_func update_callback)
 
 	while (true) {
 		update_callback();
-		sleep_ms(1000);
+		sleep_ms(SYS_TICK_MS);
 	}
 }
 
+/*
+ * The Pico has no battery backed clock and nothing sets the time yet, so the
+ * local time is unknown.
+ */
+int sys_local_time(unsigned *weekday, unsigned *minute)
+{
+	(void)weekday;
+	(void)minute;
+	return -1;
+}
+
 #else // Linux
 
 #include <stdio.h>
+#include <time.h>
 #include <unistd.h>
 
 void sys_init()
@@ -57,7 +69,24 @@ void sys_run(callback_func update_callback)
 
 	while (1) {
 		update_callback();
-		sleep(1);
+		usleep(SYS_TICK_MS * 1000);
+	}
+}
+
+/*
+ * Local day of the week (0 is Monday) and minutes since midnight.
+ * Returns 0 on success, -1 if the time is unknown.
+ */
+int sys_local_time(unsigned *weekday, unsigned *minute)
+{
+	time_t now = time(NULL);
+	struct tm local;
+	if (!localtime_r(&now, &local)) {
+		return -1;
 	}
+
+	*weekday = (unsigned)(local.tm_wday + 6) % 7;
+	*minute = (unsigned)(local.tm_hour * 60 + local.tm_min);
+	return 0;
 }
 #endif
@@ -3,7 +3,16 @@
 
 typedef void (*callback_func)(void);
 
+/*
+ * sys_run() calls back every SYS_TICK_MS, so each step of the loop must
+ * return quickly instead of waiting.
+ */
+#ifndef SYS_TICK_MS
+#define SYS_TICK_MS 2
+#endif
+
 void sys_init();
 void sys_run(callback_func update_callback);
+int sys_local_time(unsigned *weekday, unsigned *minute);
 
 #endif // SYS_H
@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "uid.h"
+
+static bool uid_valid_length(size_t len)
+{
+	if (len > UID_MAX_BYTES) {
+		return false;
+	}
+	return len == 4 || len == 7 || len == 10;
+}
+
+/*
+ * Store `len` raw UID bytes in `uid`.
+ * Returns 0 on success, -1 if the length is not a UID size we can store.
+ */
+int uid_set(struct uid *uid, const uint8_t *bytes, size_t len)
+{
+	if (!uid_valid_length(len)) {
+		return -1;
+	}
+
+	memset(uid, 0, sizeof(*uid));
+	uid->len = (uint8_t)len;
+	memcpy(uid->bytes, bytes, len);
+	return 0;
+}
+
+/*
+ * Value of one hex digit, either case, or -1 if `c` isn't one.
+ */
+int uid_hex_value(char c)
+{
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+	if (c >= 'A' && c <= 'F') {
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+/*
+ * Every UID that enters the firmware goes through here, so the ACL only ever
+ * holds one form of each UID and a lookup is a single exact compare:
+ *
+ *   - bytes are kept in the order the card sends them (UID0 first)
+ *   - the length is stored explicitly and unused bytes are zero
+ *   - 4 UID bytes followed by their BCC (XOR of the UID bytes), as the
+ *     previous reader stored them, are taken as the 4 byte UID
+ *
+ * The previous reader stored only the first cascade level of longer UIDs:
+ * the cascade tag, 3 UID bytes and the BCC. The reader now reports the
+ * whole UID, so such an entry would never match again; it is rejected with
+ * a warning and the card has to be added again with its whole UID.
+ *
+ * Returns 0 on success, -1 if the bytes are not a UID we can store.
+ */
+int uid_normalize(struct uid *uid, const uint8_t *bytes, size_t len)
+{
+	if (len == 5) {
+		uint8_t bcc = bytes[0] ^ bytes[1] ^ bytes[2] ^ bytes[3];
+		if (bcc == bytes[4]) {
+			len = 4;
+		}
+	}
+	if (len == 4 && bytes[0] == UID_CASCADE_TAG) {
+		fprintf(stderr,
+			"[WARN] UID %02x%02x%02x%02x is only the first "
+			"cascade level of a longer UID.\n",
+			bytes[0], bytes[1], bytes[2], bytes[3]);
+		return -1;
+	}
+
+	return uid_set(uid, bytes, len);
+}
+
+/*
+ * Parse a hex UID as used in the ACL file and the MQTT topics. Case doesn't
+ * matter and bytes may be separated by spaces or colons, as the reader logs
+ * them.
+ *
+ * The previous reader wrote the UID as a number, dropping leading zeros
+ * ("4a1b2c3" for 04 a1 b2 c3). Input with an odd number of digits or fewer
+ * than 8 is therefore zero padded on the left before it is decoded.
+ *
+ * Returns 0 on success, -1 on malformed input.
+ */
+int uid_from_hex(struct uid *uid, const char *hex)
+{
+	char digits[(UID_MAX_BYTES + 1) * 2];
+	size_t count = 0;
+
+	for (const char *c = hex; *c; c++) {
+		if (*c == ' ' || *c == ':') {
+			continue;
+		}
+		if (uid_hex_value(*c) < 0 || count == sizeof(digits)) {
+			return -1;
+		}
+		digits[count++] = *c;
+	}
+	if (count == 0) {
+		return -1;
+	}
+
+	size_t padded = count < 8 ? 8 : count + count % 2;
+	if (padded > sizeof(digits)) {
+		return -1;
+	}
+	size_t pad = padded - count;
+
+	uint8_t bytes[UID_MAX_BYTES + 1];
+	size_t len = padded / 2;
+	for (size_t i = 0; i < padded; i++) {
+		int value = i < pad ? 0 : uid_hex_value(digits[i - pad]);
+		if (i % 2 == 0) {
+			bytes[i / 2] = (uint8_t)(value << 4);
+		} else {
+			bytes[i / 2] |= (uint8_t)value;
+		}
+	}
+
+	return uid_normalize(uid, bytes, len);
+}
+
+/*
+ * Format `uid` as lowercase hex. `out` must hold UID_HEX_LENGTH characters.
+ */
+void uid_to_hex(const struct uid *uid, char *out)
+{
+	static const char digits[] = "0123456789abcdef";
+	size_t len = uid->len > UID_MAX_BYTES ? UID_MAX_BYTES : uid->len;
+
+	for (size_t i = 0; i < len; i++) {
+		out[i * 2] = digits[uid->bytes[i] >> 4];
+		out[i * 2 + 1] = digits[uid->bytes[i] & 0x0F];
+	}
+	out[len * 2] = '\0';
+}
+
+/*
+ * The murmur3 fmix32 avalanche, so that every output bit depends on every
+ * input bit. It finishes every FNV-1a hash the ACL keeps: UIDs, schedules
+ * and merkle nodes.
+ */
+uint32_t uid_fmix32(uint32_t h)
+{
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+	return h;
+}
+
+/*
+ * 32-bit FNV-1a over the length and UID bytes, finished with uid_fmix32().
+ * tools/go_hasher has a matching implementation; keep the two in step.
+ */
+uint32_t uid_hash(const struct uid *uid, uint32_t seed)
+{
+	uint32_t h = 2166136261u ^ seed;
+	size_t len = uid->len > UID_MAX_BYTES ? UID_MAX_BYTES : uid->len;
+
+	h = (h ^ uid->len) * 16777619u;
+	for (size_t i = 0; i < len; i++) {
+		h = (h ^ uid->bytes[i]) * 16777619u;
+	}
+
+	return uid_fmix32(h);
+}
@@ -0,0 +1,58 @@
+#ifndef UID_H
+#define UID_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * ISO 14443-A UIDs are 4, 7 or 10 bytes long (cascade level 1, 2 or 3).
+ * UID_MAX_BYTES is the widest UID we store, and the reader only reads the
+ * cascade levels that fit. 7 covers single and double size UIDs and keeps
+ * struct uid at 8 bytes; build with 4 to shrink the ACL further or 10 to
+ * read triple size UIDs. Those can't be sent in a snapshot (acl_wire.h) or
+ * hashed by tools/go_hasher, and cards using them are rare.
+ */
+#ifndef UID_MAX_BYTES
+#define UID_MAX_BYTES 7
+#endif
+
+/*
+ * The first byte of a cascade level that has more UID bytes after it. No
+ * 4 byte UID starts with it.
+ */
+#define UID_CASCADE_TAG 0x88
+
+/* two hex characters per byte plus the terminator */
+#define UID_HEX_LENGTH (UID_MAX_BYTES * 2 + 1)
+
+/*
+ * A UID in packed binary form. Unused bytes are always zero so two UIDs can
+ * be compared with a single memcmp over the whole struct. Because the length
+ * comes first, UIDs order by length and then by value.
+ */
+struct uid {
+	uint8_t len;
+	uint8_t bytes[UID_MAX_BYTES];
+};
+
+int uid_set(struct uid *uid, const uint8_t *bytes, size_t len);
+int uid_normalize(struct uid *uid, const uint8_t *bytes, size_t len);
+int uid_from_hex(struct uid *uid, const char *hex);
+void uid_to_hex(const struct uid *uid, char *out);
+uint32_t uid_hash(const struct uid *uid, uint32_t seed);
+uint32_t uid_fmix32(uint32_t h);
+int uid_hex_value(char c);
+
+static inline int uid_compare(const struct uid *a, const struct uid *b)
+{
+	return memcmp(a, b, sizeof(struct uid));
+}
+
+static inline bool uid_equal(const struct uid *a, const struct uid *b)
+{
+	return uid_compare(a, b) == 0;
+}
+
+#endif // UID_H
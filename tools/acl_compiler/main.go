@@ -0,0 +1,184 @@
+package main
+
+// acl_compiler turns a member list (one hex UID per line, the same format as
+// the device's older text ACL file) into the read-only image that
+// src/acl_image.c looks users up in. See the layout comment in src/acl_image.h.
+
+import (
+	"bufio"
+	"bytes"
+	"encoding/binary"
+	"flag"
+	"fmt"
+	"io"
+	"os"
+	"sort"
+	"strings"
+
+	"hack_rfid/tools/cardid"
+)
+
+const (
+	imageMagic   = 0x494c4341 // "ACLI"
+	imageVersion = 1
+
+	// average number of users per bucket; larger buckets make the seed
+	// array smaller but take longer to place
+	bucketSize = 4
+
+	maxSeed = 1 << 24
+)
+
+func readUsers(r io.Reader) ([][]byte, error) {
+	seen := map[string]bool{}
+	var users [][]byte
+
+	scanner := bufio.NewScanner(r)
+	for scanner.Scan() {
+		line := strings.TrimSpace(scanner.Text())
+		if line == "" || strings.HasPrefix(line, "#") {
+			continue
+		}
+		uid, err := cardid.Parse(line)
+		if err != nil {
+			return nil, err
+		}
+		if seen[string(uid)] {
+			continue
+		}
+		seen[string(uid)] = true
+		users = append(users, uid)
+	}
+	return users, scanner.Err()
+}
+
+// build places every user in its own slot with hash-and-displace: users are
+// grouped into buckets by cardid.Hash(uid, 0), and for each bucket (largest
+// first) we search for a seed that sends all of its users to free slots.
+func build(users [][]byte) (seeds []uint32, slots [][]byte, err error) {
+	n := len(users)
+	if n == 0 {
+		return nil, nil, nil
+	}
+
+	bucketCount := (n + bucketSize - 1) / bucketSize
+	buckets := make([][]int, bucketCount)
+	for i, uid := range users {
+		b := cardid.Hash(uid, 0) % uint32(bucketCount)
+		buckets[b] = append(buckets[b], i)
+	}
+
+	order := make([]int, bucketCount)
+	for i := range order {
+		order[i] = i
+	}
+	sort.SliceStable(order, func(a, b int) bool {
+		return len(buckets[order[a]]) > len(buckets[order[b]])
+	})
+
+	seeds = make([]uint32, bucketCount)
+	slots = make([][]byte, n)
+	taken := make([]bool, n)
+	placed := make([]uint32, 0, bucketSize*2)
+
+	for _, b := range order {
+		if len(buckets[b]) == 0 {
+			break
+		}
+		found := false
+		// seed 0 is the bucket hash itself, so start at 1
+		for seed := uint32(1); seed < maxSeed && !found; seed++ {
+			placed = placed[:0]
+			found = true
+			for _, i := range buckets[b] {
+				slot := cardid.Hash(users[i], seed) % uint32(n)
+				if taken[slot] || containsSlot(placed, slot) {
+					found = false
+					break
+				}
+				placed = append(placed, slot)
+			}
+			if found {
+				seeds[b] = seed
+				for k, i := range buckets[b] {
+					taken[placed[k]] = true
+					slots[placed[k]] = users[i]
+				}
+			}
+		}
+		if !found {
+			return nil, nil, fmt.Errorf("no seed found for bucket %d", b)
+		}
+	}
+	return seeds, slots, nil
+}
+
+func containsSlot(slots []uint32, slot uint32) bool {
+	for _, s := range slots {
+		if s == slot {
+			return true
+		}
+	}
+	return false
+}
+
+func encode(users [][]byte, seeds []uint32, slots [][]byte) []byte {
+	var hash uint32
+	for _, uid := range users {
+		hash += cardid.Hash(uid, 0)
+	}
+
+	var buf bytes.Buffer
+	header := struct {
+		Magic       uint32
+		Version     uint16
+		UIDBytes    uint8
+		Reserved    uint8
+		UserCount   uint32
+		BucketCount uint32
+		ACLHash     uint32
+	}{imageMagic, imageVersion, cardid.MaxBytes, 0, uint32(len(slots)), uint32(len(seeds)), hash}
+
+	binary.Write(&buf, binary.LittleEndian, header)
+	binary.Write(&buf, binary.LittleEndian, seeds)
+	for _, uid := range slots {
+		buf.Write(cardid.Pack(uid))
+	}
+	return buf.Bytes()
+}
+
+func main() {
+	in := flag.String("in", "-", "member list, one hex uid per line (- for stdin)")
+	out := flag.String("out", "acl.img", "image file to write")
+	flag.Parse()
+
+	var r io.Reader = os.Stdin
+	if *in != "-" {
+		f, err := os.Open(*in)
+		if err != nil {
+			fmt.Fprintln(os.Stderr, err)
+			os.Exit(1)
+		}
+		defer f.Close()
+		r = f
+	}
+
+	users, err := readUsers(r)
+	if err != nil {
+		fmt.Fprintln(os.Stderr, err)
+		os.Exit(1)
+	}
+
+	seeds, slots, err := build(users)
+	if err != nil {
+		fmt.Fprintln(os.Stderr, err)
+		os.Exit(1)
+	}
+
+	image := encode(users, seeds, slots)
+	if err := os.WriteFile(*out, image, 0644); err != nil {
+		fmt.Fprintln(os.Stderr, err)
+		os.Exit(1)
+	}
+	fmt.Printf("wrote %s: %d users, %d buckets, %d bytes\n", *out, len(slots), len(seeds), len(image))
+}
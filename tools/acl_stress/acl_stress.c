@@ -0,0 +1,211 @@
+/*
+ * Concurrency stress test and benchmark for the ACL snapshots in
+ * src/acl_rcu.h, built with the Linux target.
+ *
+ * Reader threads look up random UIDs while a writer keeps rebuilding and
+ * publishing snapshots. Every snapshot contains the same set of stable
+ * members plus a rotating window of churn members, so a reader that ever
+ * misses a stable member (or sees a torn list) reports a failure. Lookup
+ * throughput is measured with the writer idle and then with it running,
+ * and once more with every reader checking BATCH_USERS UIDs per call to
+ * acl_has_users_batch(), as an audit would.
+ *
+ *   acl_stress [readers] [seconds] [users]
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "acl_rcu.h"
+
+#define CHURN_USERS 256
+#define BATCH_USERS 1024
+
+static struct acl_rcu rcu;
+static size_t stable_users = 10000;
+static bool batch_lookups;
+
+static atomic_bool running;
+static atomic_bool writer_running;
+static atomic_ulong lookups;
+static atomic_ulong failures;
+static atomic_ulong swaps;
+static atomic_ulong busy;
+
+static struct uid make_uid(uint32_t n)
+{
+	uint8_t bytes[4] = {n >> 24, n >> 16, n >> 8, n};
+	struct uid uid;
+	uid_set(&uid, bytes, 4);
+	return uid;
+}
+
+/* stable members are even, churn members are odd */
+static void build_snapshot(struct access_control_list *next, uint32_t round)
+{
+	// full rebuild: throw away whatever the spare held before
+	acl_reset(next);
+
+	for (uint32_t i = 0; i < stable_users; i++) {
+		struct uid uid = make_uid(i * 2);
+		acl_append_user(next, &uid);
+	}
+	for (uint32_t i = 0; i < CHURN_USERS; i++) {
+		struct uid uid = make_uid((round * CHURN_USERS + i) * 2 + 1);
+		acl_append_user(next, &uid);
+	}
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void batch_reader(unsigned int seed)
+{
+	struct uid uids[BATCH_USERS];
+	bool found[BATCH_USERS];
+
+	while (atomic_load_explicit(&running, memory_order_relaxed)) {
+		for (size_t i = 0; i < BATCH_USERS; i++) {
+			uint32_t n =
+				(uint32_t)rand_r(&seed) % (stable_users * 2);
+			uids[i] = make_uid(n & ~1u);
+		}
+
+		struct access_control_list *acl = acl_rcu_read_lock(&rcu);
+		int status = acl_has_users_batch(acl, uids, BATCH_USERS, found);
+		acl_rcu_read_unlock(&rcu, acl);
+
+		for (size_t i = 0; i < BATCH_USERS; i++) {
+			if (status != 0 || !found[i]) {
+				atomic_fetch_add(&failures, 1);
+			}
+		}
+		atomic_fetch_add(&lookups, BATCH_USERS);
+	}
+}
+
+static void *reader_thread(void *arg)
+{
+	unsigned int seed = (unsigned int)(uintptr_t)arg;
+	unsigned long local = 0;
+
+	if (batch_lookups) {
+		batch_reader(seed);
+		return NULL;
+	}
+
+	while (atomic_load_explicit(&running, memory_order_relaxed)) {
+		uint32_t n = (uint32_t)rand_r(&seed) % (stable_users * 2);
+		struct uid uid = make_uid(n & ~1u);
+
+		struct access_control_list *acl = acl_rcu_read_lock(&rcu);
+		bool found = acl_has_user(acl, &uid);
+		acl_rcu_read_unlock(&rcu, acl);
+
+		if (!found) {
+			atomic_fetch_add(&failures, 1);
+		}
+		if (++local == 1024) {
+			atomic_fetch_add(&lookups, local);
+			local = 0;
+		}
+	}
+	atomic_fetch_add(&lookups, local);
+	return NULL;
+}
+
+static void *writer_thread(void *arg)
+{
+	(void)arg;
+	uint32_t round = 1;
+
+	while (atomic_load(&writer_running)) {
+		struct access_control_list *next =
+			acl_rcu_begin_update(&rcu, false);
+		if (!next) {
+			atomic_fetch_add(&busy, 1);
+			sched_yield();
+			continue;
+		}
+		build_snapshot(next, round++);
+		acl_rcu_publish(&rcu, next);
+		atomic_fetch_add(&swaps, 1);
+	}
+	return NULL;
+}
+
+static double run_phase(int readers, double seconds, bool with_writer)
+{
+	pthread_t threads[readers];
+	pthread_t writer;
+
+	atomic_store(&lookups, 0);
+	atomic_store(&running, true);
+	atomic_store(&writer_running, with_writer);
+
+	for (int i = 0; i < readers; i++) {
+		pthread_create(&threads[i], NULL, reader_thread,
+			(void *)(uintptr_t)(i + 1));
+	}
+	if (with_writer) {
+		pthread_create(&writer, NULL, writer_thread, NULL);
+	}
+
+	double start = now();
+	struct timespec ts = {(time_t)seconds,
+		(long)((seconds - (time_t)seconds) * 1e9)};
+	nanosleep(&ts, NULL);
+
+	atomic_store(&running, false);
+	for (int i = 0; i < readers; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	double elapsed = now() - start;
+
+	if (with_writer) {
+		atomic_store(&writer_running, false);
+		pthread_join(writer, NULL);
+	}
+	return atomic_load(&lookups) / elapsed;
+}
+
+int main(int argc, char **argv)
+{
+	int readers = argc > 1 ? atoi(argv[1]) : 4;
+	double seconds = argc > 2 ? atof(argv[2]) : 2.0;
+	if (argc > 3) {
+		stable_users = (size_t)atol(argv[3]);
+	}
+
+	if (acl_rcu_init(&rcu, "acl_stress", ACL_RAM_BUDGET) != 0) {
+		return 1;
+	}
+
+	struct access_control_list *next = acl_rcu_begin_update(&rcu, false);
+	build_snapshot(next, 0);
+	acl_rcu_publish(&rcu, next);
+
+	double idle = run_phase(readers, seconds, false);
+	double syncing = run_phase(readers, seconds, true);
+	batch_lookups = true;
+	double batched = run_phase(readers, seconds, false);
+
+	printf("readers: %d, users: %zu\n", readers, stable_users);
+	printf("lookups/s, writer idle:    %.0f\n", idle);
+	printf("lookups/s, during sync:    %.0f\n", syncing);
+	printf("lookups/s, batches of %d: %.0f\n", BATCH_USERS, batched);
+	printf("snapshots published: %lu (spare busy %lu times)\n",
+		atomic_load(&swaps), atomic_load(&busy));
+	printf("missed stable members: %lu\n", atomic_load(&failures));
+
+	acl_rcu_free(&rcu);
+	return atomic_load(&failures) == 0 ? 0 : 1;
+}
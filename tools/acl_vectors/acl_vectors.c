@@ -0,0 +1,213 @@
+/*
+ * Checks the firmware's ACL hashes and snapshot decoder against the
+ * conformance vectors in tools/go_hasher/main.go, built with the Linux
+ * target. `go run . -check` checks the server side against the same
+ * vectors, so a change to either side that breaks the other fails one of
+ * the two. Keep the vectors below in step with the Go ones.
+ *
+ *   acl_vectors
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "acl.h"
+#include "acl_wire.h"
+
+static const struct {
+	const char *uid;
+	uint32_t digest;
+} vectors[] = {
+	{"fa4efb01", 0xdfb81e2c},
+	{"fa4efb02", 0xa4fd46d5},
+	{"fa4efb03", 0x15207b00},
+	{"dbe8893f85", 0x50126300},
+	{"04a1b2c3d4e580", 0x87e29be4},
+	{"00000000", 0xdc75c20b},
+};
+
+#define VECTOR_COUNT (sizeof(vectors) / sizeof(vectors[0]))
+
+/* the ACL hash and merkle root of every uid in `vectors` */
+#define VECTORS_HASH 1312858352u
+#define VECTORS_ROOT 0x32a8988fu
+
+/* fa4efb01 restricted to Monday to Friday, 09:00 to 17:00 */
+#define SCHEDULE_HASH 0xea4d001du
+#define SCHEDULE_DIGEST 0x41f7237eu
+
+/* fa4efb02 limited to doors 1 and 2 */
+#define DOORS_MASK 0x06
+#define DOORS_DIGEST 0xcb83d15du
+
+/*
+ * The snapshot of `vectors` at generation 7, with fa4efb01 on the schedule
+ * above and fa4efb02 limited to DOORS_MASK.
+ */
+static const char wire_hex[] =
+	"010300000706ca3006d70100000000f0ffffff0f00000000000000f0ffffff0f"
+	"00000000000000f0ffffff0f00000000000000f0ffffff0f00000000000000f0"
+	"ffffff0f00000000000000000000000000000000000000000000000000000002"
+	"040500bf92a2df0dc2e399f301010102070180cbd39eacb6a802030402"
+	"81f6bbd20f01ff010006e4443e2f";
+
+/* inputs the device accepts for an already stored uid */
+static const struct {
+	const char *legacy;
+	const char *canonical;
+} legacy_forms[] = {
+	{"4a1b2c3", "04a1b2c3"},
+	{"04:A1:B2:C3", "04a1b2c3"},
+	{"04 a1 b2 c3", "04a1b2c3"},
+	{"dbe8893f85", "dbe8893f"},
+	{"234567890abcd", "0234567890abcd"},
+};
+
+/* the first cascade level of a 7 byte uid, as the previous reader stored it */
+static const char *const rejected_forms[] = {"8804a1b29f", "8804a1b2"};
+
+static unsigned failures;
+
+static void expect(const char *what, uint32_t got, uint32_t want)
+{
+	if (got != want) {
+		printf("FAIL %s: 0x%08X, want 0x%08X\n", what, (unsigned)got,
+			(unsigned)want);
+		failures++;
+	}
+}
+
+static void work_week(struct acl_schedule *schedule)
+{
+	acl_schedule_clear(schedule);
+	for (unsigned day = 0; day < 5; day++) {
+		acl_schedule_allow(schedule, day, 9 * 60, 17 * 60);
+	}
+}
+
+/* the digest of `hex` alone in a list, with its schedule and doors */
+static uint32_t member_digest(struct access_control_list *acl,
+	const char *hex, const struct acl_schedule *schedule, uint8_t doors)
+{
+	struct uid uid;
+	acl_reset(acl);
+	acl_append_hex(acl, hex);
+	uid_from_hex(&uid, hex);
+	if (schedule) {
+		int id = acl_schedule_add(acl, schedule);
+		if (id < 0 || acl_set_schedule(acl, &uid, (uint8_t)id) < 0) {
+			printf("FAIL %s: can't set schedule\n", hex);
+			failures++;
+		}
+	}
+	if (acl_set_doors(acl, &uid, doors) < 0) {
+		printf("FAIL %s: can't set doors\n", hex);
+		failures++;
+	}
+	return acl_hash(acl);
+}
+
+static void check_digests(struct access_control_list *acl)
+{
+	acl_reset(acl);
+	for (size_t i = 0; i < VECTOR_COUNT; i++) {
+		struct uid uid;
+		if (uid_from_hex(&uid, vectors[i].uid) != 0) {
+			printf("FAIL %s: not a uid\n", vectors[i].uid);
+			failures++;
+			continue;
+		}
+		expect(vectors[i].uid, uid_hash(&uid, 0), vectors[i].digest);
+		acl_append_user(acl, &uid);
+	}
+	expect("acl hash", acl_hash(acl), VECTORS_HASH);
+	expect("merkle root", acl_merkle_root(acl), VECTORS_ROOT);
+
+	struct acl_schedule schedule;
+	work_week(&schedule);
+	expect("schedule hash", acl_schedule_hash(&schedule), SCHEDULE_HASH);
+	expect("scheduled digest",
+		member_digest(acl, "fa4efb01", &schedule, ACL_DOORS_ALL),
+		SCHEDULE_DIGEST);
+	expect("door digest", member_digest(acl, "fa4efb02", NULL, DOORS_MASK),
+		DOORS_DIGEST);
+}
+
+static void check_wire(struct access_control_list *acl)
+{
+	uint8_t frame[sizeof(wire_hex) / 2];
+	size_t size = 0;
+	for (; wire_hex[size * 2]; size++) {
+		frame[size] = (uint8_t)(uid_hex_value(wire_hex[size * 2]) << 4
+			| uid_hex_value(wire_hex[size * 2 + 1]));
+	}
+
+	struct acl_wire_decoder decoder;
+	acl_reset(acl);
+	acl_wire_begin(&decoder, acl);
+	if (acl_wire_feed(&decoder, frame, size) != 1) {
+		printf("FAIL snapshot: not decoded\n");
+		failures++;
+		return;
+	}
+	expect("snapshot generation", acl_generation(acl), 7);
+	expect("snapshot users", (uint32_t)acl->user_count, VECTOR_COUNT);
+
+	struct acl_schedule schedule;
+	struct uid uid;
+	work_week(&schedule);
+	uid_from_hex(&uid, "fa4efb01");
+	uint8_t id = acl_user_schedule(acl, &uid);
+	if (id == 0 || memcmp(&acl->schedules[id - 1], &schedule,
+			       sizeof(schedule))
+			!= 0) {
+		printf("FAIL snapshot: fa4efb01 lost its schedule\n");
+		failures++;
+	}
+	uid_from_hex(&uid, "fa4efb02");
+	expect("snapshot doors", acl_user_doors(acl, &uid), DOORS_MASK);
+}
+
+static void check_legacy_forms(void)
+{
+	for (size_t i = 0;
+		i < sizeof(legacy_forms) / sizeof(legacy_forms[0]); i++) {
+		struct uid got;
+		struct uid want;
+		if (uid_from_hex(&got, legacy_forms[i].legacy) != 0
+			|| uid_from_hex(&want, legacy_forms[i].canonical) != 0
+			|| !uid_equal(&got, &want)) {
+			printf("FAIL \"%s\": not read as %s\n",
+				legacy_forms[i].legacy,
+				legacy_forms[i].canonical);
+			failures++;
+		}
+	}
+	for (size_t i = 0;
+		i < sizeof(rejected_forms) / sizeof(rejected_forms[0]); i++) {
+		struct uid uid;
+		if (uid_from_hex(&uid, rejected_forms[i]) == 0) {
+			printf("FAIL \"%s\": not rejected\n",
+				rejected_forms[i]);
+			failures++;
+		}
+	}
+}
+
+int main(void)
+{
+	static struct access_control_list acl;
+	if (acl_init(&acl, NULL, ACL_RAM_BUDGET) != 0) {
+		return 1;
+	}
+
+	check_digests(&acl);
+	check_wire(&acl);
+	check_legacy_forms();
+	acl_free(&acl);
+
+	if (failures) {
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
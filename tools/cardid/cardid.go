@@ -0,0 +1,84 @@
+// Package cardid parses and hashes UIDs the way src/sys/uid.c does, for the
+// tools that have to agree with the firmware: go_hasher and acl_compiler.
+package cardid
+
+import (
+	"encoding/hex"
+	"fmt"
+	"strings"
+)
+
+// MaxBytes must match UID_MAX_BYTES in src/sys/uid.h
+const MaxBytes = 7
+
+// CascadeTag is UID_CASCADE_TAG in src/sys/uid.h
+const CascadeTag = 0x88
+
+// Parse mirrors uid_from_hex in src/sys/uid.c. Spaces and colons are
+// ignored, and input with an odd number of digits or fewer than 8 is zero
+// padded on the left, because the previous reader dropped leading zeros.
+// A 5 byte value with a valid BCC is the 4 byte UID it encodes. A 4 byte
+// value starting with the cascade tag is only the first cascade level of a
+// longer UID, as the previous reader stored them, and is rejected.
+func Parse(s string) ([]byte, error) {
+	digits := strings.NewReplacer(" ", "", ":", "").Replace(s)
+	if digits == "" {
+		return nil, fmt.Errorf("uid %q is empty", s)
+	}
+	if len(digits) < 8 {
+		digits = strings.Repeat("0", 8-len(digits)) + digits
+	} else if len(digits)%2 != 0 {
+		digits = "0" + digits
+	}
+	b, err := hex.DecodeString(digits)
+	if err != nil {
+		return nil, err
+	}
+	if len(b) == 5 && b[0]^b[1]^b[2]^b[3] == b[4] {
+		b = b[:4]
+	}
+	if len(b) == 4 && b[0] == CascadeTag {
+		return nil, fmt.Errorf("uid %q is only the first cascade level of a longer uid", s)
+	}
+	switch len(b) {
+	case 4, 7, 10:
+	default:
+		return nil, fmt.Errorf("uid %q has invalid length %d", s, len(b))
+	}
+	if len(b) > MaxBytes {
+		return nil, fmt.Errorf("uid %q is longer than %d bytes", s, MaxBytes)
+	}
+	return b, nil
+}
+
+// Fmix32 mirrors uid_fmix32 in src/sys/uid.c, the murmur3 avalanche that
+// finishes every hash the firmware computes.
+func Fmix32(h uint32) uint32 {
+	h ^= h >> 16
+	h *= 0x85ebca6b
+	h ^= h >> 13
+	h *= 0xc2b2ae35
+	h ^= h >> 16
+	return h
+}
+
+// Hash mirrors uid_hash in src/sys/uid.c: FNV-1a over the length and
+// UID bytes, finished with Fmix32.
+func Hash(uid []byte, seed uint32) uint32 {
+	h := uint32(2166136261) ^ seed
+
+	h = (h ^ uint32(len(uid))) * 16777619
+	for _, b := range uid {
+		h = (h ^ uint32(b)) * 16777619
+	}
+
+	return Fmix32(h)
+}
+
+// Pack lays a UID out like struct uid: length, then zero padded bytes.
+func Pack(uid []byte) []byte {
+	packed := make([]byte, 1+MaxBytes)
+	packed[0] = byte(len(uid))
+	copy(packed[1:], uid)
+	return packed
+}
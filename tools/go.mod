@@ -0,0 +1,3 @@
+module hack_rfid/tools
+
+go 1.21
@@ -1,39 +1,224 @@
 package main
 
 import (
+	"bytes"
+	"encoding/binary"
+	"encoding/hex"
+	"flag"
 	"fmt"
-	"sort"
+	"os"
+
+	"hack_rfid/tools/cardid"
 )
 
 // aclHash needs to be a simple hashing algorithm that we can run on the server (which is golang)
-// and on the mcu (embeded C)
-func aclHash(users []string) uint32 {
-	sort.Strings(users)
-
-	var hash uint32 = 5381
+// and on the mcu (embeded C).
+// It is the sum of the per-member digests, so it doesn't depend on the order
+// of the list and the device can update it in O(1) on every add or remove.
+func aclHash(members []member) uint32 {
+	var hash uint32
 
-	for _, user := range users {
-		for _, ch := range user {
-			fmt.Printf("[HASH] Adding char '%c' (0x%02X) to hash.\n", ch, uint8(ch))
-			hash = ((hash << 5) + hash) + uint32(ch)
-		}
-		println("[HASH] Adding separator 0xFE to hash.")
-		hash = ((hash << 5) + hash) + 0xFE
+	for _, m := range members {
+		digest := memberDigest(m)
+		fmt.Printf("[HASH] Adding %x (digest 0x%08X) to hash.\n", m.uid, digest)
+		hash += digest
 	}
 
 	fmt.Printf("[HASH] Final hash value: 0x%08X\n", hash)
 	return hash
 }
 
+// conformanceVectors are digests produced by uid_hash in src/sys/uid.c.
+// If the C or Go side changes, `go test`, `go run . -check` or
+// tools/acl_vectors will point it out; keep the two lists in step.
+var conformanceVectors = []struct {
+	uid    string
+	digest uint32
+}{
+	{"fa4efb01", 0xdfb81e2c},
+	{"fa4efb02", 0xa4fd46d5},
+	{"fa4efb03", 0x15207b00},
+	{"dbe8893f85", 0x50126300},
+	{"04a1b2c3d4e580", 0x87e29be4},
+	{"00000000", 0xdc75c20b},
+}
+
+// conformanceHash is the ACL hash of every uid in conformanceVectors.
+const conformanceHash = 1312858352
+
+// conformanceRoot is acl_merkle_root() over every uid in conformanceVectors.
+const conformanceRoot = 0x32a8988f
+
+// conformanceSchedule is fa4efb01 restricted to Monday to Friday, 09:00 to
+// 17:00, as built with acl_schedule_allow().
+var conformanceSchedule = struct {
+	uid          string
+	scheduleHash uint32
+	digest       uint32
+}{"fa4efb01", 0xea4d001d, 0x41f7237e}
+
+// conformanceDoors is fa4efb02 limited to doors 1 and 2 (mask 0x06).
+var conformanceDoors = struct {
+	uid    string
+	doors  byte
+	digest uint32
+}{"fa4efb02", 0x06, 0xcb83d15d}
+
+// conformanceWire is the snapshot of conformanceVectors at generation 7,
+// with fa4efb01 on conformanceSchedule and fa4efb02 limited to
+// conformanceDoors, as decoded by acl_wire_feed().
+const conformanceWire = "010300000706ca3006d70100000000f0ffffff0f00000000000000f0ffffff0f00000000000000f0ffffff0f00000000000000f0ffffff0f00000000000000f0ffffff0f00000000000000000000000000000000000000000000000000000002040500bf92a2df0dc2e399f301010102070180cbd39eacb6a80203040281f6bbd20f01ff010006e4443e2f"
+
+// legacyForms are inputs the device accepts for an already stored uid.
+var legacyForms = []struct {
+	legacy    string
+	canonical string
+}{
+	{"4a1b2c3", "04a1b2c3"},
+	{"04:A1:B2:C3", "04a1b2c3"},
+	{"04 a1 b2 c3", "04a1b2c3"},
+	{"dbe8893f85", "dbe8893f"},
+	{"234567890abcd", "0234567890abcd"},
+}
+
+// rejectedForms are inputs the device refuses to store: the first cascade
+// level of a 7 byte uid, with and without its BCC, as the previous reader
+// stored them.
+var rejectedForms = []string{"8804a1b29f", "8804a1b2"}
+
+func checkConformance() bool {
+	ok := true
+	var users []member
+	for _, v := range conformanceVectors {
+		uid, err := cardid.Parse(v.uid)
+		if err != nil {
+			fmt.Printf("FAIL %s: %v\n", v.uid, err)
+			ok = false
+			continue
+		}
+		if got := cardid.Hash(uid, 0); got != v.digest {
+			fmt.Printf("FAIL %s: digest 0x%08X, want 0x%08X\n", v.uid, got, v.digest)
+			ok = false
+		}
+		users = append(users, member{uid: uid})
+	}
+	if got := aclHash(users); got != conformanceHash {
+		fmt.Printf("FAIL acl hash %d, want %d\n", got, uint32(conformanceHash))
+		ok = false
+	}
+	if got := merkleTree(users)[1]; got != conformanceRoot {
+		fmt.Printf("FAIL merkle root 0x%08X, want 0x%08X\n", got, uint32(conformanceRoot))
+		ok = false
+	}
+
+	schedule := make([]byte, scheduleBytes)
+	for day := 0; day < 5; day++ {
+		allowSchedule(schedule, day, 9*60, 17*60)
+	}
+	uid, _ := cardid.Parse(conformanceSchedule.uid)
+	if got := scheduleHash(schedule); got != conformanceSchedule.scheduleHash {
+		fmt.Printf("FAIL schedule hash 0x%08X, want 0x%08X\n", got, conformanceSchedule.scheduleHash)
+		ok = false
+	}
+	if got := memberDigest(member{uid: uid, schedule: schedule}); got != conformanceSchedule.digest {
+		fmt.Printf("FAIL scheduled digest 0x%08X, want 0x%08X\n", got, conformanceSchedule.digest)
+		ok = false
+	}
+
+	uid, _ = cardid.Parse(conformanceDoors.uid)
+	if got := memberDigest(member{uid: uid, deniedDoors: ^conformanceDoors.doors}); got != conformanceDoors.digest {
+		fmt.Printf("FAIL door digest 0x%08X, want 0x%08X\n", got, conformanceDoors.digest)
+		ok = false
+	}
+
+	snapshot := append([]member(nil), users...)
+	snapshot[0].schedule = schedule
+	snapshot[1].deniedDoors = ^conformanceDoors.doors
+	frames := encodeSnapshot(snapshot, 7)
+	if len(frames) != 1 || hex.EncodeToString(frames[0]) != conformanceWire {
+		fmt.Printf("FAIL snapshot %x, want %s\n", frames, conformanceWire)
+		ok = false
+	}
+
+	// legacy forms must normalize to the same uid, see uid_from_hex
+	for _, v := range legacyForms {
+		got, err := cardid.Parse(v.legacy)
+		want, _ := cardid.Parse(v.canonical)
+		if err != nil || !bytes.Equal(got, want) {
+			fmt.Printf("FAIL %q: parsed as %x, want %s\n", v.legacy, got, v.canonical)
+			ok = false
+		}
+	}
+	for _, s := range rejectedForms {
+		if got, err := cardid.Parse(s); err == nil {
+			fmt.Printf("FAIL %q: parsed as %x, want an error\n", s, got)
+			ok = false
+		}
+	}
+
+	// a device missing one user should only need that user's bucket
+	device := merkleTree(users[1:])
+	diff := diffBuckets(merkleTree(users), func(node int) uint32 { return device[node] })
+	want := merkleBucket(cardid.Hash(users[0].uid, 0))
+	if len(diff) != 1 || diff[0] != want {
+		fmt.Printf("FAIL merkle diff %v, want [%d]\n", diff, want)
+		ok = false
+	}
+	return ok
+}
+
 func main() {
-	users := []string{
-		"alice",
-		"bob",
-		"charlie",
-		"allen",
-		// "alf",
-		"chris",
+	check := flag.Bool("check", false, "verify the hash against the firmware's conformance vectors")
+	tree := flag.Bool("tree", false, "also print the merkle tree root and bucket hashes")
+	wire := flag.String("wire", "", "also write the members as snapshot frames to this file, each after its length as a little-endian uint16")
+	generation := flag.Uint("generation", 0, "generation to put in the snapshot written by -wire")
+	flag.Parse()
+
+	if *check {
+		if !checkConformance() {
+			os.Exit(1)
+		}
+		fmt.Println("OK")
+		return
+	}
+
+	// same fobs as init_acl() in src/main.c
+	args := flag.Args()
+	if len(args) == 0 {
+		args = []string{
+			"fa4efb01",
+			"fa4efb02",
+			"fa4efb03",
+			"dbe8893f85",
+		}
+	}
+
+	// a member is "<uid>[,<schedule hex>[,<door mask hex>]]"
+	var users []member
+	for _, arg := range args {
+		m, err := parseMember(arg)
+		if err != nil {
+			fmt.Fprintln(os.Stderr, err)
+			os.Exit(1)
+		}
+		users = append(users, m)
 	}
 	hash := aclHash(users)
 	fmt.Printf("ACL Hash: %d\n", hash)
+	if *tree {
+		printTree(merkleTree(users))
+	}
+	if *wire != "" {
+		var out []byte
+		frames := encodeSnapshot(users, uint32(*generation))
+		for _, frame := range frames {
+			out = binary.LittleEndian.AppendUint16(out, uint16(len(frame)))
+			out = append(out, frame...)
+		}
+		if err := os.WriteFile(*wire, out, 0o644); err != nil {
+			fmt.Fprintln(os.Stderr, err)
+			os.Exit(1)
+		}
+		fmt.Printf("Snapshot: %d frames, %d bytes\n", len(frames), len(out))
+	}
 }
@@ -0,0 +1,10 @@
+package main
+
+import "testing"
+
+// TestConformance runs the same vectors as `go run . -check`.
+func TestConformance(t *testing.T) {
+	if !checkConformance() {
+		t.Fatal("conformance vectors don't match the firmware's")
+	}
+}
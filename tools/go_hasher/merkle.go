@@ -0,0 +1,91 @@
+package main
+
+import (
+	"fmt"
+
+	"hack_rfid/tools/cardid"
+)
+
+// merkleDepth must match ACL_MERKLE_DEPTH in src/acl_merkle.h
+const merkleDepth = 6
+
+const merkleBuckets = 1 << merkleDepth
+
+// merkleBucket mirrors acl_merkle_bucket: users are bucketed by the top bits
+// of their digest.
+func merkleBucket(digest uint32) int {
+	return int(digest >> (32 - merkleDepth))
+}
+
+// merkleCombine mirrors merkle_combine in src/acl_merkle.c.
+func merkleCombine(left, right uint32) uint32 {
+	h := uint32(2166136261)
+
+	for i := 0; i < 4; i++ {
+		h = (h ^ ((left >> (i * 8)) & 0xFF)) * 16777619
+	}
+	for i := 0; i < 4; i++ {
+		h = (h ^ ((right >> (i * 8)) & 0xFF)) * 16777619
+	}
+
+	return cardid.Fmix32(h)
+}
+
+// merkleTree returns every node hash, numbered like the firmware: tree[1] is
+// the root, the children of n are 2n and 2n+1, and bucket b is leaf
+// tree[merkleBuckets+b]. tree[0] is unused.
+func merkleTree(members []member) []uint32 {
+	tree := make([]uint32, 2*merkleBuckets)
+	for _, m := range members {
+		// the bucket only depends on the uid, the sum includes the schedule
+		tree[merkleBuckets+merkleBucket(cardid.Hash(m.uid, 0))] += memberDigest(m)
+	}
+	for n := merkleBuckets - 1; n > 0; n-- {
+		tree[n] = merkleCombine(tree[2*n], tree[2*n+1])
+	}
+	return tree
+}
+
+// deviceTree is what the server can ask a reader for: the hash of any node.
+type deviceTree func(node int) uint32
+
+// diffBuckets walks down from the root, only descending into subtrees whose
+// hashes differ, and returns the buckets the server has to resend. A few
+// changed fobs cost O(merkleDepth) queries each instead of a full resync.
+func diffBuckets(server []uint32, device deviceTree) []int {
+	var buckets []int
+	var walk func(node int)
+	walk = func(node int) {
+		if server[node] == device(node) {
+			return
+		}
+		if node >= merkleBuckets {
+			buckets = append(buckets, node-merkleBuckets)
+			return
+		}
+		walk(2 * node)
+		walk(2*node + 1)
+	}
+	walk(1)
+	return buckets
+}
+
+// usersInBucket returns the users the server would send for one bucket.
+func usersInBucket(members []member, bucket int) []member {
+	var out []member
+	for _, m := range members {
+		if merkleBucket(cardid.Hash(m.uid, 0)) == bucket {
+			out = append(out, m)
+		}
+	}
+	return out
+}
+
+func printTree(tree []uint32) {
+	fmt.Printf("[MERKLE] root 0x%08X\n", tree[1])
+	for b := 0; b < merkleBuckets; b++ {
+		if tree[merkleBuckets+b] != 0 {
+			fmt.Printf("[MERKLE] bucket %d: 0x%08X\n", b, tree[merkleBuckets+b])
+		}
+	}
+}
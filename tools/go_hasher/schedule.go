@@ -0,0 +1,91 @@
+package main
+
+import (
+	"encoding/hex"
+	"fmt"
+	"strings"
+
+	"hack_rfid/tools/cardid"
+)
+
+// scheduleBytes must match ACL_SCHEDULE_BYTES in src/acl_schedule.h: one bit
+// per 15 minutes of the week, starting Monday 00:00, slot s in bit s%8 of
+// byte s/8.
+const scheduleBytes = 7 * 24 * 60 / 15 / 8
+
+// member is a uid plus its weekly schedule (nil is unrestricted) and the
+// doors it may not use (0 is every door, ACL_DOORS_ALL in src/acl.h).
+type member struct {
+	uid         []byte
+	schedule    []byte
+	deniedDoors byte
+}
+
+// parseMember parses "<uid>[,<schedule hex>[,<door mask hex>]]"; an empty
+// schedule is unrestricted.
+func parseMember(s string) (member, error) {
+	fields := strings.Split(s, ",")
+	uid, err := cardid.Parse(fields[0])
+	if err != nil {
+		return member{}, err
+	}
+	m := member{uid: uid}
+	if len(fields) > 1 && fields[1] != "" {
+		if m.schedule, err = parseSchedule(fields[1]); err != nil {
+			return member{}, err
+		}
+	}
+	if len(fields) > 2 {
+		doors, err := hex.DecodeString(fields[2])
+		if err != nil || len(doors) != 1 {
+			return member{}, fmt.Errorf("door mask %q is not one hex byte", fields[2])
+		}
+		m.deniedDoors = ^doors[0]
+	}
+	return m, nil
+}
+
+// parseSchedule parses the hex bitmap used in the MQTT payloads.
+func parseSchedule(s string) ([]byte, error) {
+	b, err := hex.DecodeString(s)
+	if err != nil {
+		return nil, err
+	}
+	if len(b) != scheduleBytes {
+		return nil, fmt.Errorf("schedule has %d bytes, want %d", len(b), scheduleBytes)
+	}
+	return b, nil
+}
+
+// allowSchedule mirrors acl_schedule_allow: open `weekday` (0 is Monday)
+// from startMinute up to, but not including, endMinute.
+func allowSchedule(schedule []byte, weekday, startMinute, endMinute int) {
+	for slot := (weekday*24*60 + startMinute) / 15; slot < (weekday*24*60+endMinute)/15; slot++ {
+		schedule[slot/8] |= 1 << (slot % 8)
+	}
+}
+
+// scheduleHash mirrors acl_schedule_hash in src/acl_schedule.c.
+func scheduleHash(schedule []byte) uint32 {
+	h := uint32(2166136261)
+	for _, b := range schedule {
+		h = (h ^ uint32(b)) * 16777619
+	}
+
+	h = cardid.Fmix32(h)
+	if h == 0 {
+		return 1
+	}
+	return h
+}
+
+// memberDigest mirrors acl_user_digest in src/acl.c: uid_hash seeded with the
+// denied doors in the top byte and the schedule's hash, so an unrestricted
+// member's seed is 0.
+func memberDigest(m member) uint32 {
+	seed := uint32(m.deniedDoors) << 24
+	if m.schedule != nil {
+		seed ^= scheduleHash(m.schedule)
+	}
+	return cardid.Hash(m.uid, seed)
+}
@@ -0,0 +1,165 @@
+package main
+
+import (
+	"bytes"
+	"encoding/binary"
+	"hash/crc32"
+	"sort"
+)
+
+// The snapshot wire format decoded by src/acl_wire.c; the constants must
+// match src/acl_wire.h.
+const (
+	wireVersion  = 1
+	wireFrameMax = 512
+
+	wireFirst = 0x01
+	wireLast  = 0x02
+
+	wireSchedule = 1
+	wireUsers    = 2
+	wireAttrs    = 3
+
+	// version, flags and seq
+	wireHeader = 4
+	wireCRC    = 4
+	// tag, uid length and a count of up to 2 varint bytes
+	wireSectionHeader = 4
+)
+
+type wireWriter struct {
+	frames [][]byte
+	cur    []byte
+}
+
+func (w *wireWriter) newFrame() {
+	if w.cur != nil {
+		w.frames = append(w.frames, w.cur)
+	}
+	w.cur = []byte{wireVersion, 0, 0, 0}
+}
+
+func (w *wireWriter) room() int {
+	return wireFrameMax - wireCRC - len(w.cur)
+}
+
+// writeSection writes uids of one length, given as big-endian integers in
+// increasing order, each followed by its extra bytes. A section that doesn't
+// fit is continued in the next frame, with the deltas starting over from 0.
+func (w *wireWriter) writeSection(tag byte, uidLen int, keys []uint64, extra [][]byte) {
+	for len(keys) > 0 {
+		var body []byte
+		prev := uint64(0)
+		n := 0
+		for ; n < len(keys); n++ {
+			entry := binary.AppendUvarint(nil, keys[n]-prev)
+			if extra != nil {
+				entry = append(entry, extra[n]...)
+			}
+			if wireSectionHeader+len(body)+len(entry) > w.room() {
+				break
+			}
+			body = append(body, entry...)
+			prev = keys[n]
+		}
+		if n == 0 {
+			w.newFrame()
+			continue
+		}
+
+		w.cur = append(w.cur, tag, byte(uidLen))
+		w.cur = binary.AppendUvarint(w.cur, uint64(n))
+		w.cur = append(w.cur, body...)
+		keys = keys[n:]
+		if extra != nil {
+			extra = extra[n:]
+		}
+	}
+}
+
+// uidKey reads a uid as a big-endian integer.
+func uidKey(uid []byte) uint64 {
+	var key uint64
+	for _, b := range uid {
+		key = key<<8 | uint64(b)
+	}
+	return key
+}
+
+// encodeSnapshot encodes every member as the frames acl_wire_feed() takes,
+// for a device that should end up at `generation`.
+func encodeSnapshot(members []member, generation uint32) [][]byte {
+	sorted := append([]member(nil), members...)
+	// the firmware's order: shorter uids first, then bytewise
+	sort.Slice(sorted, func(i, j int) bool {
+		a, b := sorted[i].uid, sorted[j].uid
+		if len(a) != len(b) {
+			return len(a) < len(b)
+		}
+		return bytes.Compare(a, b) < 0
+	})
+
+	var hash uint32
+	for _, m := range sorted {
+		hash += memberDigest(m)
+	}
+
+	w := &wireWriter{}
+	w.newFrame()
+	w.cur = binary.AppendUvarint(w.cur, uint64(generation))
+	w.cur = binary.AppendUvarint(w.cur, uint64(len(sorted)))
+	w.cur = binary.LittleEndian.AppendUint32(w.cur, hash)
+
+	// schedules are numbered from 1 in the order they are sent
+	ids := map[string]byte{}
+	for _, m := range sorted {
+		if m.schedule == nil || ids[string(m.schedule)] != 0 {
+			continue
+		}
+		if 1+scheduleBytes > w.room() {
+			w.newFrame()
+		}
+		w.cur = append(w.cur, wireSchedule)
+		w.cur = append(w.cur, m.schedule...)
+		ids[string(m.schedule)] = byte(len(ids) + 1)
+	}
+
+	// every user first, then the members with a schedule or door mask
+	type section struct {
+		uidLen int
+		keys   []uint64
+		extra  [][]byte
+	}
+	var attrSections []section
+	for start := 0; start < len(sorted); {
+		users := section{uidLen: len(sorted[start].uid)}
+		attrs := section{uidLen: users.uidLen}
+		for ; start < len(sorted) && len(sorted[start].uid) == users.uidLen; start++ {
+			m := sorted[start]
+			users.keys = append(users.keys, uidKey(m.uid))
+			if m.schedule != nil || m.deniedDoors != 0 {
+				attrs.keys = append(attrs.keys, uidKey(m.uid))
+				attrs.extra = append(attrs.extra, []byte{ids[string(m.schedule)], ^m.deniedDoors})
+			}
+		}
+		w.writeSection(wireUsers, users.uidLen, users.keys, nil)
+		attrSections = append(attrSections, attrs)
+	}
+	for _, attrs := range attrSections {
+		w.writeSection(wireAttrs, attrs.uidLen, attrs.keys, attrs.extra)
+	}
+
+	// number the frames and seal each with its CRC
+	w.frames = append(w.frames, w.cur)
+	for i, frame := range w.frames {
+		binary.LittleEndian.PutUint16(frame[2:], uint16(i))
+		if i == 0 {
+			frame[1] |= wireFirst
+		}
+		if i == len(w.frames)-1 {
+			frame[1] |= wireLast
+		}
+		w.frames[i] = binary.LittleEndian.AppendUint32(frame, crc32.ChecksumIEEE(frame))
+	}
+	return w.frames
+}
@@ -0,0 +1,361 @@
+/*
+ * Benchmark and regression test for the MFRC522 driver and rfid_reader.c,
+ * built with the Linux target against the simulated chip in
+ * src/sys/device/mfrc522_sim.c.
+ *
+ * Every scenario runs the reader the way the main loop does, one
+ * rfid_reader_poll() per SYS_TICK_MS, once with the IRQ pin wired and once
+ * polling the chip. For each it prints the SPI transactions, bytes and bus
+ * time the driver used and the virtual time it took. A card that isn't read
+ * exactly once per presentation is a failure, and so is a UID that belongs
+ * to no card or a card-to-UID latency over MAX_LATENCY_MS. A card with a
+ * UID longer than UID_MAX_BYTES must be reported as one failed read instead.
+ *
+ * The local time the reader goes by is the simulator's, so the poll rate
+ * doesn't depend on when the bench runs. Idle polling is measured once the
+ * reader no longer counts boot as a recent read, in quiet and busy hours.
+ *
+ * The collision scenarios put cards with fixed UIDs in the field together
+ * and check the order they are read in and the CollPos the chip reported
+ * against positions worked out by hand from ISO 14443-3.
+ *
+ *   rfid_bench [rounds]
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "device/mfrc522.h"
+#include "device/mfrc522_sim.h"
+#include "pico/stdlib.h"
+#include "rfid_reader.h"
+#include "sys.h"
+
+/* a card must be read within one idle poll period */
+#define MAX_LATENCY_MS RFID_POLL_IDLE_MS
+#define WALLET_CARDS 5
+/* Monday 03:00 and 18:00, outside and inside RFID_BUSY_FROM-UNTIL */
+#define QUIET_MINUTE (3 * 60)
+#define BUSY_MINUTE (18 * 60)
+
+static struct rfid_reader reader;
+static unsigned failures;
+static unsigned seed = 1;
+/* failed reads, and cards read, since the last present() or collide() */
+static unsigned read_errors;
+static unsigned read_count;
+
+struct card {
+	uint8_t uid[10];
+	size_t len;
+	int handle;
+	unsigned reads;
+	/* read_count when the card was first read, 0 if it wasn't */
+	unsigned order;
+};
+
+/*
+ * Cards that collide, the order they must be read in and the CollPos
+ * (CollReg bits 4-0) the chip reports, in that order. A UID
+ * bit n, counted from 1 at bit 0 of the first byte of the cascade level,
+ * collides at CollPos n when the answer starts at that byte; after a
+ * collision the answer starts at the first unknown bit, which keeps the
+ * count (RxAlign). 0 is the 32nd bit.
+ */
+struct collision {
+	const char *what;
+	size_t count;
+	struct {
+		uint8_t uid[10];
+		size_t len;
+	} cards[3];
+	uint8_t order[3];
+	size_t coll_count;
+	uint8_t coll_pos[3];
+};
+
+static const struct collision collisions[] = {
+	// bit 1 of UID0, the first bit the cards send
+	{"collide at bit 1", 2,
+		{{{0x10, 0x20, 0x30, 0x40}, 4},
+			{{0x11, 0x20, 0x30, 0x40}, 4}},
+		{1, 0}, 1, {1}},
+	// bit 32, the top bit of UID3, just before the BCC
+	{"collide at bit 32", 2,
+		{{{0x11, 0x22, 0x33, 0x44}, 4},
+			{{0x11, 0x22, 0x33, 0xC4}, 4}},
+		{1, 0}, 1, {0}},
+	// bit 4 for all three, then bit 13 sent after 4 known bits
+	{"3 cards, bits 4 and 13", 3,
+		{{{0x0F, 0x00, 0x00, 0x00}, 4},
+			{{0x0F, 0x10, 0x00, 0x00}, 4},
+			{{0x07, 0x00, 0x00, 0x00}, 4}},
+		{1, 0, 2}, 3, {4, 13, 4}},
+	// the ATQAs 0x04 and 0x44 differ in the UID size, bit 7 of the
+	// answer to REQA; then UID0 0x08 against the cascade tag 0x88: bit 8
+	{"4 and 7 byte, CL1", 2,
+		{{{0x08, 0xAA, 0xBB, 0xCC}, 4},
+			{{0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07}, 7}},
+		{1, 0}, 2, {7, 8}},
+	// the same CL1, bit 32 of CL2
+	{"7 byte, CL2 bit 32", 2,
+		{{{0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07}, 7},
+			{{0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x87}, 7}},
+		{1, 0}, 1, {0}},
+#if UID_MAX_BYTES >= 10
+	// the same CL1 and CL2, bit 25 of CL3
+	{"10 byte, CL3 bit 25", 2,
+		{{{0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09,
+			  0x0A},
+			 10},
+			{{0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+				 0x09, 0x0B},
+				10}},
+		{1, 0}, 1, {25}},
+#endif
+};
+
+static void random_card(struct card *card)
+{
+	for (size_t i = 0; i < card->len; i++) {
+		card->uid[i] = (uint8_t)rand_r(&seed);
+	}
+	if (card->uid[0] == PICC_CASCADE_TAG) {
+		card->uid[0] = 0;
+	}
+	card->reads = 0;
+	card->order = 0;
+}
+
+/* whether the reader reads `card`, or reports it as a failed read */
+static bool readable(const struct card *card)
+{
+	return card->len <= UID_MAX_BYTES;
+}
+
+/*
+ * Poll for `ms`, counting which of `cards` were read. Returns the virtual
+ * time the reader first reported a card, read or not, in ns, or 0 if it
+ * didn't.
+ */
+static uint64_t poll_for(struct card *cards, size_t count, uint32_t ms)
+{
+	uint64_t first = 0;
+	absolute_time_t end = make_timeout_time_ms(ms);
+
+	while (!time_reached(end)) {
+		struct uid uid;
+		int ret = rfid_reader_poll(&reader, &uid);
+		if (ret != 0 && !first) {
+			first = mfrc522_sim_now_ns();
+		}
+		if (ret < 0) {
+			read_errors++;
+		}
+		if (ret > 0) {
+			bool known = false;
+			read_count++;
+			for (size_t i = 0; i < count; i++) {
+				struct card *card = &cards[i];
+				if (uid.len == card->len
+					&& !memcmp(uid.bytes, card->uid,
+						uid.len)) {
+					known = true;
+					if (!card->reads++) {
+						card->order = read_count;
+					}
+				}
+			}
+			if (!known) {
+				printf("read a UID of %u bytes no card has\n",
+					uid.len);
+				failures++;
+			}
+		}
+		sleep_ms(SYS_TICK_MS);
+	}
+	return first;
+}
+
+static void print_stats(const char *mode, const char *what, unsigned n)
+{
+	struct mfrc522_sim_stats stats;
+	mfrc522_sim_stats_get(&stats);
+	printf("%-7s %-22s %7.1f %8.1f %9.1f %7.1f %7.1f\n", mode, what,
+		(double)stats.transactions / n, (double)stats.bytes / n,
+		stats.bus_ns / 1e3 / n, (double)stats.frames / n,
+		stats.elapsed_ns / 1e6 / n);
+}
+
+/*
+ * Present the cards together for half a second, then take them away. The
+ * figures are per round, idle polling before and after the read included.
+ */
+static void present(const char *mode, const char *what, struct card *cards,
+	size_t count, unsigned rounds)
+{
+	uint64_t latency_sum = 0;
+	uint64_t latency_max = 0;
+
+	mfrc522_sim_stats_reset();
+	for (unsigned round = 0; round < rounds; round++) {
+		for (size_t i = 0; i < count; i++) {
+			struct card *card = &cards[i];
+			random_card(card);
+			card->handle =
+				mfrc522_sim_add_card(card->uid, card->len);
+		}
+
+		read_errors = 0;
+		read_count = 0;
+		uint64_t start = mfrc522_sim_now_ns();
+		uint64_t first = poll_for(cards, count, 500);
+		uint64_t latency = first ? first - start : UINT64_MAX;
+		latency_sum += latency;
+		if (latency > latency_max) {
+			latency_max = latency;
+		}
+
+		unsigned unreadable = 0;
+		for (size_t i = 0; i < count; i++) {
+			unsigned want = readable(&cards[i]) ? 1 : 0;
+			if (cards[i].reads != want) {
+				printf("%s: card %zu of %zu read %u times\n",
+					what, i + 1, count, cards[i].reads);
+				failures++;
+			}
+			unreadable += !want;
+			mfrc522_sim_remove_card(cards[i].handle);
+		}
+		// each unreadable card is halted after one failed read
+		if (read_errors != unreadable) {
+			printf("%s: %u failed reads, want %u\n", what,
+				read_errors, unreadable);
+			failures++;
+		}
+		// the next card arrives at a random point of the poll cycle
+		poll_for(NULL, 0, 50 + rand_r(&seed) % 50);
+	}
+	print_stats(mode, what, rounds);
+
+	printf("%-7s %-22s latency %.1f ms avg, %.1f ms max\n", mode, "",
+		latency_sum / 1e6 / rounds, latency_max / 1e6);
+	if (latency_max > MAX_LATENCY_MS * 1000000ull) {
+		printf("%s: latency over %d ms\n", what, MAX_LATENCY_MS);
+		failures++;
+	}
+}
+
+/*
+ * Present the cards of `c` together for half a second and check they were
+ * read in order, each once, with the collisions it lists.
+ */
+static void collide(const char *mode, const struct collision *c)
+{
+	struct card cards[3];
+
+	mfrc522_sim_stats_reset();
+	read_errors = 0;
+	read_count = 0;
+	for (size_t i = 0; i < c->count; i++) {
+		memcpy(cards[i].uid, c->cards[i].uid, c->cards[i].len);
+		cards[i].len = c->cards[i].len;
+		cards[i].reads = 0;
+		cards[i].order = 0;
+		cards[i].handle =
+			mfrc522_sim_add_card(cards[i].uid, cards[i].len);
+	}
+
+	poll_for(cards, c->count, 500);
+	print_stats(mode, c->what, 1);
+
+	for (size_t i = 0; i < c->count; i++) {
+		const struct card *card = &cards[c->order[i]];
+		if (card->reads != 1 || card->order != i + 1) {
+			printf("%s: card %u read %u times, as number %u of "
+			       "%zu\n",
+				c->what, c->order[i] + 1, card->reads,
+				card->order, c->count);
+			failures++;
+		}
+	}
+
+	uint8_t coll_pos[8];
+	size_t n = mfrc522_sim_collisions(coll_pos, sizeof(coll_pos));
+	if (n != c->coll_count
+		|| memcmp(coll_pos, c->coll_pos, c->coll_count) != 0) {
+		printf("%s: CollPos", c->what);
+		for (size_t i = 0; i < n; i++) {
+			printf(" %u", coll_pos[i]);
+		}
+		printf(", want");
+		for (size_t i = 0; i < c->coll_count; i++) {
+			printf(" %u", c->coll_pos[i]);
+		}
+		printf("\n");
+		failures++;
+	}
+
+	for (size_t i = 0; i < c->count; i++) {
+		mfrc522_sim_remove_card(cards[i].handle);
+	}
+	poll_for(NULL, 0, 50);
+}
+
+static void run(bool irq_wired, unsigned rounds)
+{
+	const char *mode = irq_wired ? "irq" : "polled";
+	struct card one = {.len = 4};
+	struct card double_size = {.len = 7};
+	struct card triple_size = {.len = 10};
+	struct card wallet[WALLET_CARDS];
+	for (size_t i = 0; i < WALLET_CARDS; i++) {
+		wallet[i].len = i % 2 ? 7 : 4;
+	}
+
+	mfrc522_sim_connect(
+		RFID_PIN_CS, RFID_PIN_RST, RFID_PIN_IRQ, irq_wired);
+	rfid_reader_init(&reader);
+
+	// one second with nobody at the door, once the reader has stopped
+	// polling fast for the read it counts at boot
+	mfrc522_sim_set_local_time(0, QUIET_MINUTE);
+	poll_for(NULL, 0, RFID_RECENT_MS);
+	mfrc522_sim_stats_reset();
+	poll_for(NULL, 0, 1000);
+	print_stats(mode, "idle, per second", 1);
+
+	mfrc522_sim_set_local_time(0, BUSY_MINUTE);
+	mfrc522_sim_stats_reset();
+	poll_for(NULL, 0, 1000);
+	print_stats(mode, "idle, busy hours", 1);
+	mfrc522_sim_set_local_time(0, QUIET_MINUTE);
+
+	present(mode, "4 byte UID", &one, 1, rounds);
+	present(mode, "7 byte UID", &double_size, 1, rounds);
+	present(mode, readable(&triple_size) ? "10 byte UID"
+					     : "10 byte UID, unreadable",
+		&triple_size, 1, rounds);
+	present(mode, "wallet of 5", wallet, WALLET_CARDS, rounds);
+	for (size_t i = 0; i < sizeof(collisions) / sizeof(collisions[0]);
+		i++) {
+		collide(mode, &collisions[i]);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	unsigned rounds = argc > 1 ? (unsigned)atoi(argv[1]) : 50;
+	if (rounds == 0) {
+		rounds = 1;
+	}
+
+	printf("%-7s %-22s %7s %8s %9s %7s %7s\n", "mode", "per round",
+		"spi", "bytes", "bus us", "frames", "ms");
+	run(true, rounds);
+	run(false, rounds);
+
+	printf("failures: %u\n", failures);
+	return failures == 0 ? 0 : 1;
+}